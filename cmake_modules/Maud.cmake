@@ -103,6 +103,25 @@ endfunction()
 
 
 function(_maud_glob out_var root_dir)
+  find_program(_MAUD_GLOB maud_glob)
+  mark_as_advanced(_MAUD_GLOB)
+  if(_MAUD_GLOB)
+    set(backend "")
+    if(MAUD_GLOB_BACKEND STREQUAL "GIT" AND root_dir STREQUAL CMAKE_SOURCE_DIR)
+      set(backend "--git")
+    endif()
+
+    # maud_glob produces the same list as below, but prunes hidden directories
+    # instead of filtering them after the fact.
+    execute_process(
+      COMMAND "${_MAUD_GLOB}" ${backend} "${root_dir}"
+      OUTPUT_VARIABLE matches
+      COMMAND_ERROR_IS_FATAL ANY
+    )
+    set(${out_var} ${matches} PARENT_SCOPE)
+    return()
+  endif()
+
   file(
     GLOB_RECURSE matches
     LIST_DIRECTORIES true
@@ -183,6 +202,7 @@ endfunction()
 
 
 function(_maud_write_scan_script source_file)
+  _maud_needs_preprocessing_scan("${source_file}" preprocessing)
   _maud_preprocessing_scan_options("${source_file}" flags)
 
   # The scan script accepts one argument:
@@ -197,16 +217,40 @@ function(_maud_write_scan_script source_file)
   else()
     set(arg "$1")
   endif()
-  set(scan "${CMAKE_CXX_SCANDEP_SOURCE}\n")
-  string(REPLACE <CMAKE_CXX_COMPILER> "\"${CMAKE_CXX_COMPILER}\"" scan "${scan}")
-  string(REPLACE <FLAGS> "${flags}" scan "${scan}")
-  string(REPLACE <DEFINES> "" scan "${scan}")
-  string(REPLACE <INCLUDES> "" scan "${scan}")
-  string(REPLACE <SOURCE> "\"${source_file}\"" scan "${scan}")
-  string(REPLACE <OBJECT> "\"${obj_path}\"" scan "${scan}")
-  string(REPLACE <DEP_FILE> "\"${ddi_path}.d\"" scan "${scan}")
-  string(REPLACE <DYNDEP_FILE> "\"${ddi_path}${arg}\"" scan "${scan}")
-  string(REPLACE <PREPROCESSED_SOURCE> "\"${ddi_path}.preprocessed\"" scan "${scan}")
+  # Scans are cached by maud_scan, keyed on the source's preamble (and the
+  # scan command for preprocessing scans), so a source whose modification
+  # time changed without changing its module declarations won't be scanned.
+  set(cache "\"${_MAUD_SCAN}\" \"--cache=${MAUD_DIR}/ddi/cache\"")
+  string(APPEND cache " \"--defines=${MAUD_DIR}/options.h\"")
+  if(NOT preprocessing)
+    set(scan "${cache} \"${source_file}\" \"${ddi_path}${arg}\"\n")
+  else()
+    set(scan "${CMAKE_CXX_SCANDEP_SOURCE}\n")
+    string(REPLACE <CMAKE_CXX_COMPILER> "\"${CMAKE_CXX_COMPILER}\"" scan "${scan}")
+    string(REPLACE <FLAGS> "${flags}" scan "${scan}")
+    string(REPLACE <DEFINES> "" scan "${scan}")
+    string(REPLACE <INCLUDES> "" scan "${scan}")
+    string(REPLACE <SOURCE> "\"${source_file}\"" scan "${scan}")
+    string(REPLACE <OBJECT> "\"${obj_path}\"" scan "${scan}")
+    string(REPLACE <DEP_FILE> "\"${ddi_path}.d\"" scan "${scan}")
+    string(REPLACE <DYNDEP_FILE> "\"${ddi_path}${arg}\"" scan "${scan}")
+    string(REPLACE <PREPROCESSED_SOURCE> "\"${ddi_path}.preprocessed\"" scan "${scan}")
+
+    if(_MAUD_SCAN)
+      string(STRIP "${scan}" scan)
+      string(SHA1 flags "${scan}")
+      # The compiler's depfile lists the headers it included, whose contents
+      # must also be unchanged for a cached scan to be reused.
+      string(APPEND cache " --flags=${flags} \"--depfile=${ddi_path}.d\"")
+      string(APPEND cache " \"${source_file}\" \"${ddi_path}${arg}\"")
+      if(MSVC)
+        set(exit "exit /b 0")
+      else()
+        set(exit "exit 0")
+      endif()
+      set(scan "${cache} --lookup && ${exit}\n${scan} && ${cache} --store\n")
+    endif()
+  endif()
   if(MSVC)
     file(WRITE "${ddi_path}.scan.bat" "${scan}\n")
   else()
@@ -215,6 +259,40 @@ function(_maud_write_scan_script source_file)
 endfunction()
 
 
+function(_maud_needs_preprocessing_scan source_file out_var)
+  # Sources are scanned with maud_scan unless it couldn't be found,
+  # a source explicitly requests a preprocessing scan, or maud_scan
+  # couldn't evaluate its preprocessing conditions.
+  get_source_file_property(
+    flags
+    "${source_file}"
+    MAUD_PREPROCESSING_SCAN_OPTIONS
+  )
+  get_source_file_property(
+    required
+    "${source_file}"
+    MAUD_PREPROCESSING_SCAN_REQUIRED
+  )
+  if(NOT _MAUD_SCAN OR flags OR required)
+    set(${out_var} ON PARENT_SCOPE)
+  else()
+    set(${out_var} OFF PARENT_SCOPE)
+  endif()
+endfunction()
+
+
+function(_maud_preprocessing_scan_required source_file)
+  # Called by maud_scan's fragment for sources with preprocessing conditions it
+  # couldn't evaluate.
+  message(VERBOSE "preprocessing scan required for ${source_file}")
+  set_source_files_properties(
+    "${source_file}"
+    PROPERTIES
+    MAUD_PREPROCESSING_SCAN_REQUIRED ON
+  )
+endfunction()
+
+
 function(_maud_preprocessing_scan_options source_file out_var)
   get_source_file_property(
     flags
@@ -225,6 +303,12 @@ function(_maud_preprocessing_scan_options source_file out_var)
     set(flags "")
   endif()
   string(APPEND flags " ${CMAKE_CXX${CMAKE_CXX_STANDARD}_STANDARD_COMPILE_OPTION}")
+  # Preprocess with the same option definitions which are included in compilation
+  if(MSVC)
+    string(APPEND flags " /FI\"${MAUD_DIR}/options.h\"")
+  else()
+    string(APPEND flags " -include \"${MAUD_DIR}/options.h\"")
+  endif()
   get_directory_property(dirs INCLUDE_DIRECTORIES)
   foreach(dir ${dirs})
     string(APPEND flags " ${CMAKE_INCLUDE_FLAG_CXX} \"${dir}\"")
@@ -258,7 +342,62 @@ function(_maud_cxx_sources)
   endif()
   _maud_set(_MAUD_CXX_SCANNED_SOURCES "${_MAUD_CXX_SOURCES}")
 
+  find_program(_MAUD_SCAN maud_scan)
+  mark_as_advanced(_MAUD_SCAN)
+
+  set(batch "")
+  set(batch_sources "")
+  set(preprocessing "")
+  set(preprocessing_sources "")
   foreach(source_file ${_MAUD_CXX_SCANNED_SOURCES})
+    _maud_write_scan_script("${source_file}")
+    _maud_needs_preprocessing_scan("${source_file}" needs_preprocessing)
+    _maud_get_ddi_path("${source_file}" ddi)
+    if(needs_preprocessing)
+      list(APPEND preprocessing "${source_file}" "${ddi}")
+      list(APPEND preprocessing_sources "${source_file}")
+    else()
+      list(APPEND batch "${source_file}" "${ddi}")
+      list(APPEND batch_sources "${source_file}")
+    endif()
+  endforeach()
+
+  if(batch_sources)
+    # Scan everything which doesn't need preprocessing with a single invocation
+    # of maud_scan, which writes each ddi and a cmake fragment which passes the
+    # scan results of each source to _maud_scanned().
+    file(WRITE "${MAUD_DIR}/ddi/batch.list" "${batch}")
+    execute_process(
+      COMMAND
+        "${_MAUD_SCAN}"
+        "--batch=${MAUD_DIR}/ddi/batch.list"
+        "--defines=${MAUD_DIR}/options.h"
+        "--cmake=${MAUD_DIR}/ddi/scanned.cmake"
+        "--cache=${MAUD_DIR}/ddi/cache"
+      COMMAND_ERROR_IS_FATAL ANY
+    )
+    include("${MAUD_DIR}/ddi/scanned.cmake")
+
+    # maud_scan evaluates preprocessing conditions against options.h, but sources
+    # with declarations whose conditions depend on anything else are handed off
+    # to the compiler.
+    foreach(source_file ${batch_sources})
+      get_source_file_property(required "${source_file}" MAUD_PREPROCESSING_SCAN_REQUIRED)
+      if(required)
+        _maud_write_scan_script("${source_file}")
+        _maud_get_ddi_path("${source_file}" ddi)
+        list(REMOVE_ITEM batch "${source_file}" "${ddi}")
+        list(APPEND preprocessing "${source_file}" "${ddi}")
+        list(APPEND preprocessing_sources "${source_file}")
+      endif()
+    endforeach()
+  endif()
+
+  # These lists are also used to rescan during glob verification.
+  file(WRITE "${MAUD_DIR}/ddi/batch.list" "${batch}")
+  file(WRITE "${MAUD_DIR}/ddi/preprocessing.list" "${preprocessing}")
+
+  foreach(source_file ${preprocessing_sources})
     _maud_scan("${source_file}")
   endforeach()
 endfunction()
@@ -332,16 +471,7 @@ endfunction()
 
 
 function(_maud_scan source_file)
-  # TODO I'd like the scanning to be multithreaded for speed.
-  # This is pretty easy since execute_process with multiple
-  # COMMANDS runs them all as a pipeline (with single shared
-  # stderr). Therefore all we really need is a cross platform
-  # `nproc` to find out how many commands we want and a
-  # `-P DoScan.cmake` which receives a subset of the files to
-  # scan.
-  message(VERBOSE "scanning ${source_file}")
-
-  _maud_write_scan_script("${source_file}")
+  # Run the scan script then read back the p1689 ddi it wrote.
   _maud_get_ddi_path("${source_file}" ddi)
 
   if(MSVC)
@@ -350,44 +480,65 @@ function(_maud_scan source_file)
     set(command sh "${ddi}.scan.sh")
   endif()
   execute_process(COMMAND ${command} COMMAND_ERROR_IS_FATAL ANY)
-
-  # ... and read back the ddi
   file(READ "${ddi}" ddi)
 
-  # collect all imports
+  # collect all imports, except header units (which have a lookup-method)
   json_list(imports ERROR_VARIABLE error GET "${ddi}" rules 0 requires [] logical-name)
   if(NOT imports)
     set(imports)
   endif()
+  string(JSON count ERROR_VARIABLE error LENGTH "${ddi}" rules 0 requires)
+  if(NOT error AND count GREATER 0)
+    math_assign(count - 1)
+    foreach(i RANGE ${count})
+      string(
+        JSON method ERROR_VARIABLE error
+        GET "${ddi}" rules 0 requires ${i} lookup-method
+      )
+      if(NOT error)
+        string(JSON header_unit GET "${ddi}" rules 0 requires ${i} logical-name)
+        list(REMOVE_ITEM imports "${header_unit}")
+      endif()
+    endforeach()
+  endif()
 
   string(JSON module ERROR_VARIABLE error GET "${ddi}" rules 0 _maud_module-name)
   if(NOT error)
     message(FATAL_ERROR "FIXME not yet supported")
-    list(REMOVE_ITEM imports "${module}")
-    set(type IMPLEMENTATION)
-  else()
-    set(module "")
   endif()
 
+  set(logical-name "")
+  set(is-interface OFF)
   string(JSON provides ERROR_VARIABLE error GET "${ddi}" rules 0 provides 0)
   if(NOT error)
     string(JSON logical-name GET ${provides} logical-name)
     string(JSON is-interface GET ${provides} is-interface)
-    if(logical-name MATCHES "(.+):(.+)")
-      set(module ${CMAKE_MATCH_1})
-      set(partition ${CMAKE_MATCH_2})
-    else()
-      set(module ${logical-name})
-      set(partition "")
-    endif()
+  endif()
 
-    if(is-interface)
-      set(type INTERFACE)
-    else()
-      set(type PROVIDER)
-    endif()
-  else()
-    set(is-interface OFF)
+  _maud_scanned("${source_file}" "${logical-name}" "${is-interface}" "${imports}")
+endfunction()
+
+
+function(_maud_scanned source_file logical-name is-interface imports)
+  # Attach a scanned source to its target. Scan results are passed directly
+  # (maud_scan writes calls to this function for batches of sources) or read
+  # from a ddi by _maud_scan(). logical-name is empty if the source provides
+  # no module.
+  message(VERBOSE "scanning ${source_file}")
+
+  set(module "")
+  set(partition "")
+  if(logical-name MATCHES "(.+):(.+)")
+    set(module ${CMAKE_MATCH_1})
+    set(partition ${CMAKE_MATCH_2})
+  elseif(NOT logical-name STREQUAL "")
+    set(module ${logical-name})
+  endif()
+
+  if(is-interface)
+    set(type INTERFACE)
+  elseif(NOT module STREQUAL "")
+    set(type PROVIDER)
   endif()
 
   if(module STREQUAL "")
@@ -535,22 +686,54 @@ function(_maud_add_test source_file partition out_target_name)
     PROPERTIES
     COMPILE_DEFINITIONS SUITE_NAME=${name}
   )
-  set(${out_target_name} "test_.${name}" PARENT_SCOPE)
-
-  if(NOT TARGET "test_.${name}")
-    add_executable(test_.${name})
-  endif()
-  add_test(NAME test_.${name} COMMAND $<TARGET_FILE:test_.${name}> --gtest_brief=1)
-  target_sources(
-    test_.${name}
-    PRIVATE
-    FILE_SET module_providers
-    TYPE CXX_MODULES
-    ${_MAUD_BASE_DIRS}
-    FILES "${_MAUD_SELF_DIR}/test_.cxx"
-  )
+
+  if(MAUD_TEST_EXECUTABLES GREATER 0)
+    # Suites are assigned by a hash of their name so that adding or removing
+    # a suite only relinks the executable which contains it.
+    string(SHA1 hash "${name}")
+    string(SUBSTRING "${hash}" 0 7 hash)
+    math(EXPR i "0x${hash} % ${MAUD_TEST_EXECUTABLES} + 1")
+    set(target "test_.executable_${i}")
+    set(filter "--gtest_filter=${name}.*")
+  else()
+    set(target "test_.${name}")
+    set(filter)
+  endif()
+  set(${out_target_name} "${target}" PARENT_SCOPE)
+
+  if(NOT TARGET "${target}")
+    add_executable(${target})
+  endif()
+  add_test(NAME test_.${name} COMMAND $<TARGET_FILE:${target}> --gtest_brief=1 ${filter})
+  set_property(TARGET ${target} APPEND PROPERTY MAUD_TEST_SUITES "${name}")
+
+  # test_ is compiled once into an object library which every test executable
+  # links to, rather than being compiled again for each.
+  if(NOT TARGET test_)
+    add_library(test_ OBJECT)
+    target_sources(
+      test_
+      PUBLIC
+      FILE_SET module_providers
+      TYPE CXX_MODULES
+      ${_MAUD_BASE_DIRS}
+      FILES "${_MAUD_SELF_DIR}/test_.cxx"
+    )
+    target_compile_features(test_ PUBLIC cxx_std_${CMAKE_CXX_STANDARD})
+    set_target_properties(
+      test_
+      PROPERTIES
+      COMPILE_OPTIONS "${_MAUD_INCLUDE} ${_MAUD_SELF_DIR}/test_.hxx"
+    )
+  endif()
+
+  get_target_property(interface ${target} MAUD_INTERFACE)
+  if(interface)
+    return()
+  endif()
+  target_link_libraries(${target} PRIVATE test_)
   set_target_properties(
-    test_.${name}
+    ${target}
     PROPERTIES
     MAUD_INTERFACE "${_MAUD_SELF_DIR}/test_.cxx"
     COMPILE_OPTIONS "${_MAUD_INCLUDE} ${_MAUD_SELF_DIR}/test_.hxx"
@@ -600,6 +783,25 @@ function(_maud_finalize_targets)
     DIRECTORY .
     PROPERTY BUILDSYSTEM_TARGETS
   )
+
+  if(_MAUD_TEST_MAIN)
+    set(test_main "${_MAUD_TEST_MAIN}")
+  else()
+    set(test_main "${_MAUD_SELF_DIR}/test_main_.cxx")
+  endif()
+  if(TARGET test_)
+    # Test executables get test_:main along with test_ by linking to it.
+    target_sources(
+      test_
+      PUBLIC
+      FILE_SET module_providers
+      TYPE CXX_MODULES
+      BASE_DIRS ${_MAUD_BASE_DIRS}
+      FILES "${test_main}"
+    )
+    target_link_libraries(test_ PUBLIC GTest::gtest)
+  endif()
+
   foreach(target ${targets})
     if(target MATCHES "^_maud")
       continue()
@@ -665,23 +867,18 @@ function(_maud_finalize_targets)
     endif()
     print_target_sources(${target})
 
-    if(TEST ${target})
-      if(NOT COMMAND "maud_add_test")
-        target_link_libraries(${target} PRIVATE GTest::gtest_main)
-      endif()
-      if(_MAUD_TEST_MAIN)
-        set(test_main "${_MAUD_TEST_MAIN}")
-      else()
-        set(test_main "${_MAUD_SELF_DIR}/test_main_.cxx")
+    get_target_property(suites ${target} MAUD_TEST_SUITES)
+    if(TEST ${target} OR suites)
+      if(COMMAND "maud_add_test")
+        target_sources(
+          ${target}
+          PRIVATE
+          FILE_SET module_providers
+          TYPE CXX_MODULES
+          BASE_DIRS ${_MAUD_BASE_DIRS}
+          FILES "${test_main}"
+        )
       endif()
-      target_sources(
-        ${target}
-        PRIVATE
-        FILE_SET module_providers
-        TYPE CXX_MODULES
-        BASE_DIRS ${_MAUD_BASE_DIRS}
-        FILES "${test_main}"
-      )
       continue()
     endif()
 
@@ -741,45 +938,79 @@ endfunction()
 function(_maud_maybe_regenerate)
   set(total_set_changed FALSE)
 
-  _maud_glob(all "${CMAKE_SOURCE_DIR}")
-  if(NOT "${all}" STREQUAL "${_MAUD_ALL}")
-    message(VERBOSE "change to _MAUD_ALL detected")
-    _maud_print_glob_changes("${_MAUD_ALL}" "${all}")
+  _maud_watch_reports_no_changes(unchanged)
+  if(unchanged)
+    message(VERBOSE "maud_watch reported no changes to the total file set")
+  else()
+    _maud_glob(all "${CMAKE_SOURCE_DIR}")
+    if(NOT "${all}" STREQUAL "${_MAUD_ALL}")
+      message(VERBOSE "change to _MAUD_ALL detected")
+      _maud_print_glob_changes("${_MAUD_ALL}" "${all}")
+
+      set(total_set_changed TRUE)
+      _maud_set(_MAUD_ALL "${all}")
+      file(WRITE "${MAUD_DIR}/cache_updates/_MAUD_ALL" "${all}")
+    endif()
 
-    set(total_set_changed TRUE)
-    _maud_set(_MAUD_ALL "${all}")
-    file(WRITE "${MAUD_DIR}/cache_updates/_MAUD_ALL" "${all}")
-  endif()
+    _maud_glob(all "${MAUD_DIR}/rendered")
+    if(NOT "${all}" STREQUAL "${_MAUD_ALL_GENERATED}")
+      message(VERBOSE "change to _MAUD_ALL_GENERATED detected")
+      _maud_print_glob_changes("${_MAUD_ALL_GENERATED}" "${all}")
 
-  _maud_glob(all "${MAUD_DIR}/rendered")
-  if(NOT "${all}" STREQUAL "${_MAUD_ALL_GENERATED}")
-    message(VERBOSE "change to _MAUD_ALL_GENERATED detected")
-    _maud_print_glob_changes("${_MAUD_ALL_GENERATED}" "${all}")
+      set(total_set_changed TRUE)
+      _maud_set(_MAUD_ALL_GENERATED "${all}")
+      file(WRITE "${MAUD_DIR}/cache_updates/_MAUD_ALL_GENERATED" "${all}")
+    endif()
 
-    set(total_set_changed TRUE)
-    _maud_set(_MAUD_ALL_GENERATED "${all}")
-    file(WRITE "${MAUD_DIR}/cache_updates/_MAUD_ALL_GENERATED" "${all}")
+    unset(all)
+    # The journaled changes have been globbed, so they needn't be again.
+    file(REMOVE "${MAUD_DIR}/watch/journal")
   endif()
 
-  unset(all)
-
   if(NOT total_set_changed)
     message(VERBOSE "total file set is unchanged, skipping glob verification")
   else()
+    find_program(_MAUD_GLOB maud_glob)
+    mark_as_advanced(_MAUD_GLOB)
+    if(_MAUD_GLOB)
+      # Evaluate every glob in one pass with maud_glob's compiled matchers, rather
+      # than calling list(FILTER) for each pattern of each glob.
+      set(globs "${CMAKE_SOURCE_DIR}\n${_MAUD_ALL}\n")
+      string(APPEND globs "${MAUD_DIR}/rendered\n${_MAUD_ALL_GENERATED}\n")
+      foreach(glob ${_MAUD_GLOBS})
+        string(APPEND globs "${glob};${_MAUD_GLOB_ARGUMENTS_${glob}}\n")
+      endforeach()
+      file(WRITE "${MAUD_DIR}/globs.list" "${globs}")
+      execute_process(
+        COMMAND
+          "${_MAUD_GLOB}"
+          "--filter=${MAUD_DIR}/globs.list"
+          "--output=${MAUD_DIR}/globs.cmake"
+        COMMAND_ERROR_IS_FATAL ANY
+      )
+      include("${MAUD_DIR}/globs.cmake")
+      unset(globs)
+    endif()
+
     foreach(glob ${_MAUD_GLOBS})
       message(VERBOSE "checking for different matches to: ${_MAUD_GLOB_ARGUMENTS_${glob}}")
       set(old "${${glob}}")
-      unset(${glob} CACHE)
-      glob(${glob} ${_MAUD_GLOB_ARGUMENTS_${glob}})
+      if(DEFINED _MAUD_FILTERED_${glob})
+        set(new "${_MAUD_FILTERED_${glob}}")
+      else()
+        unset(${glob} CACHE)
+        glob(${glob} ${_MAUD_GLOB_ARGUMENTS_${glob}})
+        set(new "${${glob}}")
+      endif()
 
-      if("${old}" STREQUAL "${${glob}}")
+      if("${old}" STREQUAL "${new}")
         continue()
       endif()
 
       message(STATUS "change in glob ${glob} detected, will regenerate")
-      _maud_print_glob_changes("${old}" "${${glob}}")
-      file(WRITE "${MAUD_DIR}/cache_updates/${glob}" "${${glob}}")
-      _maud_set(${glob} "${${glob}}")
+      _maud_print_glob_changes("${old}" "${new}")
+      file(WRITE "${MAUD_DIR}/cache_updates/${glob}" "${new}")
+      _maud_set(${glob} "${new}")
 
       if("CONFIGURE_DEPENDS" IN_LIST _MAUD_GLOB_ARGUMENTS_${glob})
         file(TOUCH_NOCREATE "${CMAKE_BINARY_DIR}/CMakeFiles/cmake.verify_globs")
@@ -787,6 +1018,29 @@ function(_maud_maybe_regenerate)
     endforeach()
 
     unset(old)
+    unset(new)
+  endif()
+
+  if(_MAUD_SCAN)
+    # Check and rescan all sources concurrently with a single invocation of maud_scan,
+    # which prints only the differing scan results.
+    execute_process(
+      COMMAND
+        "${_MAUD_SCAN}"
+        --rescan
+        "--batch=${MAUD_DIR}/ddi/batch.list"
+        "--defines=${MAUD_DIR}/options.h"
+        "--scripts=${MAUD_DIR}/ddi/preprocessing.list"
+        "--cache=${MAUD_DIR}/ddi/cache"
+      OUTPUT_VARIABLE scan-results-differ
+      OUTPUT_STRIP_TRAILING_WHITESPACE
+      COMMAND_ERROR_IS_FATAL ANY
+    )
+    if(scan-results-differ)
+      message(STATUS "change detected ${scan-results-differ}, will regenerate")
+      file(TOUCH_NOCREATE "${CMAKE_BINARY_DIR}/CMakeFiles/cmake.verify_globs")
+    endif()
+    return()
   endif()
 
   foreach(source_file ${_MAUD_CXX_SCANNED_SOURCES})
@@ -799,27 +1053,93 @@ function(_maud_maybe_regenerate)
 endfunction()
 
 
+function(_maud_watch_reports_no_changes out_var)
+  set(${out_var} FALSE PARENT_SCOPE)
+  if(NOT MAUD_WATCH OR NOT _MAUD_WATCH OR NOT EXISTS "${MAUD_DIR}/watch/lock")
+    return()
+  endif()
+
+  # maud_watch holds this lock while it is running, so if we can acquire it
+  # the watcher has died and we can't rely on its journal.
+  file(
+    LOCK "${MAUD_DIR}/watch/lock"
+    GUARD FUNCTION
+    RESULT_VARIABLE lock_result
+    TIMEOUT 0
+  )
+  if(lock_result STREQUAL "0")
+    message(VERBOSE "maud_watch is not running")
+    return()
+  endif()
+
+  # Wait for the watcher to journal any events which preceded this point. The
+  # wait blocks on a lock rather than polling, but a watcher which is stuck
+  # would never release it, so give up after a second and glob instead.
+  execute_process(
+    COMMAND "${_MAUD_WATCH}" --sync "${MAUD_DIR}/watch"
+    RESULT_VARIABLE sync_result
+    TIMEOUT 1
+  )
+  if(NOT sync_result STREQUAL "0")
+    message(VERBOSE "maud_watch did not respond: ${sync_result}")
+    return()
+  endif()
+
+  if(EXISTS "${MAUD_DIR}/watch/journal")
+    file(READ "${MAUD_DIR}/watch/journal" journal)
+    message(VERBOSE "maud_watch journal:\n${journal}")
+    return()
+  endif()
+  set(${out_var} TRUE PARENT_SCOPE)
+endfunction()
+
+
+function(_maud_setup_watch)
+  if(NOT MAUD_WATCH)
+    if(EXISTS "${MAUD_DIR}/watch/lock")
+      # Stop any watcher left over from when MAUD_WATCH was enabled.
+      file(WRITE "${MAUD_DIR}/watch/stop" "")
+    endif()
+    return()
+  endif()
+
+  if(NOT CMAKE_HOST_SYSTEM_NAME STREQUAL "Linux")
+    message(WARNING "MAUD_WATCH is only supported on Linux")
+    return()
+  endif()
+
+  find_program(_MAUD_WATCH maud_watch)
+  mark_as_advanced(_MAUD_WATCH)
+  if(NOT _MAUD_WATCH)
+    message(WARNING "MAUD_WATCH is enabled but maud_watch was not found")
+    return()
+  endif()
+  find_program(_MAUD_SETSID setsid REQUIRED)
+  mark_as_advanced(_MAUD_SETSID)
+
+  # We just globbed everything, so previously journaled changes are irrelevant.
+  # (If a watcher is already running it will keep running.)
+  file(REMOVE "${MAUD_DIR}/watch/journal" "${MAUD_DIR}/watch/stop")
+  file(MAKE_DIRECTORY "${MAUD_DIR}/watch")
+  execute_process(
+    COMMAND
+      "${_MAUD_SETSID}" --fork
+      "${_MAUD_WATCH}" "${MAUD_DIR}/watch" "${CMAKE_SOURCE_DIR}" "${MAUD_DIR}/rendered"
+    OUTPUT_FILE "${MAUD_DIR}/watch/log"
+    ERROR_FILE "${MAUD_DIR}/watch/log"
+    COMMAND_ERROR_IS_FATAL ANY
+  )
+endfunction()
+
+
 function(_maud_setup_regenerate)
   if("${_MAUD_INJECT_REGENERATE}" STREQUAL "")
     find_program(_MAUD_INJECT_REGENERATE maud_inject_regenerate REQUIRED)
   endif()
 
-  if(WIN32)
-    file(
-      WRITE "${MAUD_DIR}/inject.bat"
-      "@ECHO OFF\r\n"
-      "start /b \"${_MAUD_INJECT_REGENERATE}\" \"${CMAKE_BINARY_DIR}\"\r\n"
-    )
-    set(command "${MAUD_DIR}/inject.bat")
-  else()
-    find_program(_MAUD_SETSID setsid REQUIRED)
-    mark_as_advanced(_MAUD_SETSID)
-    set(
-      command
-      "${_MAUD_SETSID}" --fork
-      "${_MAUD_INJECT_REGENERATE}" "${CMAKE_BINARY_DIR}"
-    )
-  endif()
+  # maud_inject_regenerate detaches itself, but only after it has locked
+  # inject.lock. maud_cli.cmake blocks on that lock before building.
+  set(command "${_MAUD_INJECT_REGENERATE}" "${CMAKE_BINARY_DIR}")
 
   if(EXISTS "${MAUD_DIR}/maud_inject_regenerate.error")
     file(REMOVE "${MAUD_DIR}/maud_inject_regenerate.error")
@@ -839,21 +1159,55 @@ function(_maud_setup_regenerate)
   # regenerate anyway (because a new .error file will be
   # detected), report the error in the block above, and try again.
   file(GLOB _ CONFIGURE_DEPENDS "${MAUD_DIR}/maud_inject_regenerate.error")
+
+  _maud_setup_watch()
+  _maud_write_cache_snapshot()
+endfunction()
+
+
+function(_maud_write_cache_snapshot)
+  # Parsing CMakeCache.txt in script mode is slow, as is parsing a script which
+  # contains very long arguments. Instead, write every cache variable's value
+  # end-to-end into cache.values, with a script which reads each back by offset.
+  get_cmake_property(vars CACHE_VARIABLES)
+  set(index "")
+  set(values "")
+  set(offset 0)
+  foreach(var ${vars})
+    set(value "$CACHE{${var}}")
+    string(LENGTH "${value}" length)
+    if(length EQUAL 0)
+      string(APPEND index "_maud_set(${var} \"\")\n")
+      continue()
+    endif()
+    string(
+      APPEND index
+      "file(READ \"\${values}\" value OFFSET ${offset} LIMIT ${length})\n"
+      "_maud_set(${var} \"\${value}\")\n"
+    )
+    string(APPEND values "${value}")
+    math(EXPR offset "${offset} + ${length}")
+  endforeach()
+  file(WRITE "${MAUD_DIR}/cache.values" "${values}")
+  file(WRITE "${MAUD_DIR}/cache.cmake" "${index}")
 endfunction()
 
 
 function(_maud_load_cache build_dir)
   if(NOT build_dir STREQUAL "CONFIGURING")
-    # We haven't loaded CMakeCache.txt yet, so do that now.
+    # We haven't loaded the cache yet, so do that now.
     # Unset vars which are just CWD in script mode.
     unset(CMAKE_SOURCE_DIR PARENT_SCOPE)
     unset(CMAKE_BINARY_DIR PARENT_SCOPE)
-    file(READ "${build_dir}/CMakeCache.txt" cache)
-    string(CONCAT pattern "^(.*\n)" [[([^#/].*):.+=]] "([^\n]*)" "\n(.*)$")
-    while(cache MATCHES "${pattern}")
-      set(cache "${CMAKE_MATCH_1}")
-      _maud_set(${CMAKE_MATCH_2} "${CMAKE_MATCH_3}")
-    endwhile()
+    if(EXISTS "${build_dir}/_maud/cache.cmake")
+      set(values "${build_dir}/_maud/cache.values")
+      include("${build_dir}/_maud/cache.cmake")
+    else()
+      # Build directories configured before snapshots were written
+      # won't have one until they are next reconfigured.
+      message(VERBOSE "No cache snapshot in ${build_dir}, reading CMakeCache.txt")
+      _maud_load_cache_txt("${build_dir}")
+    endif()
   endif()
 
   _maud_glob(updates "${MAUD_DIR}/cache_updates")
@@ -869,6 +1223,16 @@ function(_maud_load_cache build_dir)
 endfunction()
 
 
+function(_maud_load_cache_txt build_dir)
+  file(READ "${build_dir}/CMakeCache.txt" cache)
+  string(CONCAT pattern "^(.*\n)" [[([^#/].*):.+=]] "([^\n]*)" "\n(.*)$")
+  while(cache MATCHES "${pattern}")
+    set(cache "${CMAKE_MATCH_1}")
+    _maud_set(${CMAKE_MATCH_2} "${CMAKE_MATCH_3}")
+  endwhile()
+endfunction()
+
+
 function(_maud_eval)
   if(DEFINED MAUD_CODE)
     cmake_language(EVAL CODE "${MAUD_CODE}")
@@ -980,6 +1344,36 @@ function(_maud_setup)
     MARK_AS_ADVANCED
   )
 
+  option(
+    MAUD_TEST_EXECUTABLES
+    STRING "If greater than 0, test suites are distributed among this many executables."
+    DEFAULT 0
+    MARK_AS_ADVANCED
+  )
+
+  option(
+    MAUD_WATCH
+    BOOL "Watch for changes to the file set in the background so builds needn't glob."
+    DEFAULT OFF
+    MARK_AS_ADVANCED
+  )
+
+  option(
+    MAUD_IN2_TRACES
+    ENUM INLINE SOURCE_MAP
+      "Where in2 compilation traces are written; SOURCE_MAP trims them to one line."
+    DEFAULT INLINE
+    MARK_AS_ADVANCED
+  )
+
+  option(
+    MAUD_GLOB_BACKEND
+    ENUM FILESYSTEM GIT
+      "How source files are listed for globbing. GIT excludes files ignored by git."
+    DEFAULT FILESYSTEM
+    MARK_AS_ADVANCED
+  )
+
   cmake_language(GET_MESSAGE_LOG_LEVEL level)
   option(
     CMAKE_MESSAGE_LOG_LEVEL
@@ -1037,24 +1431,96 @@ endfunction()
 
 function(_maud_in2)
   glob(_MAUD_IN2 CONFIGURE_DEPENDS EXCLUDE_RENDERED "[.]in2$")
+  if(NOT _MAUD_IN2)
+    return()
+  endif()
+
+  # Compile all templates with a single invocation of maud_in2, which skips
+  # those whose compiled script is already up to date.
+  set(batch)
   foreach(template ${_MAUD_IN2})
-    cmake_path(GET template PARENT_PATH dir)
     cmake_path(GET template STEM LAST_ONLY RENDER_FILE)
+    list(
+      APPEND batch
+      "${template}"
+      "${MAUD_DIR}/compiled_templates/${RENDER_FILE}.in2.cmake"
+    )
+  endforeach()
+  file(WRITE "${MAUD_DIR}/compiled_templates/batch.list" "${batch}")
+
+  set(source_maps)
+  string(COMPARE EQUAL "${MAUD_IN2_TRACES}" "SOURCE_MAP" is_source_map)
+  if(is_source_map)
+    set(source_maps "--source-maps")
+  endif()
+  unset(is_source_map)
+
+  # maud_in2 also renders templates which need no cmake commands, given the
+  # variables which would be visible to them (so this scope's variables are
+  # dumped as they will be when the remaining templates are rendered below).
+  # It mirrors the built-in filters, so if any of those have been redefined
+  # every template is rendered by cmake instead.
+  set(render_natively)
+  _maud_in2_builtin_filters_redefined(redefined)
+  if(NOT redefined)
+    set(
+      render_natively
+      "--variables=${MAUD_DIR}/compiled_templates/variables"
+      "--rendered=${MAUD_DIR}/rendered"
+    )
+    get_cmake_property(cache_vars CACHE_VARIABLES)
+    get_cmake_property(vars VARIABLES)
+    set(dump "")
+    foreach(var ${cache_vars} ${vars})
+      # (cache_vars is unset below, so it won't be visible to templates)
+      if(var MATCHES "^[A-Za-z0-9_./+-]+$" AND NOT var STREQUAL "cache_vars")
+        string(LENGTH "${${var}}" length)
+        string(APPEND dump "${var}\n${length}\n${${var}}")
+      endif()
+    endforeach()
+    file(WRITE "${MAUD_DIR}/compiled_templates/variables" "${dump}")
+    unset(cache_vars)
+    unset(vars)
+    unset(var)
+    unset(length)
+    unset(dump)
+  endif()
 
-    set(compiled "${MAUD_DIR}/compiled_templates/${RENDER_FILE}.in2.cmake")
-    file(WRITE "${compiled}" "")
+  execute_process(
+    COMMAND
+      maud_in2
+      ${source_maps}
+      "--batch=${MAUD_DIR}/compiled_templates/batch.list"
+      ${render_natively}
+    OUTPUT_VARIABLE unrendered
+    COMMAND_ERROR_IS_FATAL ANY
+  )
+  if(redefined)
+    set(unrendered "${_MAUD_IN2}")
+  endif()
 
-    execute_process(
-      COMMAND maud_in2
-      INPUT_FILE "${template}"
-      OUTPUT_FILE "${compiled}"
-      COMMAND_ERROR_IS_FATAL ANY
-    )
+  foreach(template ${unrendered})
+    cmake_path(GET template PARENT_PATH dir)
+    cmake_path(GET template STEM LAST_ONLY RENDER_FILE)
+    set(compiled "${MAUD_DIR}/compiled_templates/${RENDER_FILE}.in2.cmake")
 
     set(RENDER_FILE "${MAUD_DIR}/rendered/${RENDER_FILE}")
-    file(WRITE "${RENDER_FILE}" "")
-    include("${compiled}")
+    _maud_render("${compiled}")
+  endforeach()
+endfunction()
+
+
+# CMake keeps a redefined command available under its name with a leading
+# underscore, so a built-in filter has been redefined if that exists.
+function(_maud_in2_builtin_filters_redefined out_var)
+  foreach(filter "" set if_else string string_literal join)
+    if(COMMAND "_in2_pipeline_filter_${filter}")
+      message(VERBOSE "in2_pipeline_filter_${filter} was redefined")
+      set(${out_var} ON PARENT_SCOPE)
+      return()
+    endif()
   endforeach()
+  set(${out_var} OFF PARENT_SCOPE)
 endfunction()
 
 
@@ -1825,9 +2291,25 @@ endfunction()
 # in2 helpers and pipeline filters
 ################################################################################
 
-# render directly to file
+# Render a compiled template to ${RENDER_FILE}. Output is accumulated in memory
+# and only written if it differs from the file's current contents, so that
+# re-rendering an unchanged template doesn't trigger a rebuild.
+function(_maud_render compiled)
+  set_property(GLOBAL PROPERTY _MAUD_RENDERED "")
+  include("${compiled}")
+  get_property(rendered GLOBAL PROPERTY _MAUD_RENDERED)
+  if(EXISTS "${RENDER_FILE}")
+    file(READ "${RENDER_FILE}" old)
+    string(COMPARE EQUAL "${old}" "${rendered}" unchanged)
+    if(unchanged)
+      return()
+    endif()
+  endif()
+  file(WRITE "${RENDER_FILE}" "${rendered}")
+endfunction()
+
 function(render content)
-  file(APPEND "${RENDER_FILE}" "${content}")
+  set_property(GLOBAL APPEND_STRING PROPERTY _MAUD_RENDERED "${content}")
 endfunction()
 
 function(in2_pipeline_filter_)
@@ -179,12 +179,9 @@ if(generate_only)
   return()
 endif()
 
-set(verify)
-while(NOT (verify MATCHES "INJECTED BY MAUD"))
-  if(EXISTS "${build_dir}/CMakeFiles/VerifyGlobs.cmake")
-    file(READ "${build_dir}/CMakeFiles/VerifyGlobs.cmake" verify)
-  endif()
-endwhile()
+# maud_inject_regenerate holds this lock until VerifyGlobs.cmake is patched.
+file(LOCK "${build_dir}/_maud/inject.lock")
+file(LOCK "${build_dir}/_maud/inject.lock" RELEASE)
 
 execute_process(
   COMMAND
@@ -4,11 +4,20 @@ module;
 #include <gmock/gmock-matchers.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <any>
+#include <chrono>
+#include <cmath>
 #include <coroutine>
 #include <cstdint>
+#include <deque>
 #include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
 #include <sstream>
+#include <string_view>
+#include <utility>
 #include <vector>
 export module test_;
 export import :main;
@@ -24,11 +33,6 @@ auto const type_name<std::string> = "std::string";
 export template <>
 auto const type_name<std::string_view> = "std::string_view";
 
-export struct Main {
-  Main(int &argc, char **argv) { InitGoogleTest(&argc, argv); }
-  int run() { return RUN_ALL_TESTS(); }
-};
-
 template <typename T>
 concept Complete = requires {
   { sizeof(T) } -> std::same_as<std::size_t>;
@@ -39,13 +43,175 @@ concept SizedRange = requires(R range) {
   { range.size() } -> std::same_as<std::size_t>;
 };
 
-std::vector<std::any> parameters;
+// Registered tests point into these, so they must not move when more are added.
+// (A small parameter like a tuple of ints is stored inline in its std::any.)
+std::deque<std::any> parameters;
+
+// Registrations which must wait until --gtest_filter has been parsed.
+std::vector<std::function<void()>> deferred_registrations;
+
+// Benchmarks are only registered if the test program is run with --benchmark.
+std::vector<std::function<void()>> deferred_benchmarks;
+bool benchmarks_enabled = false;
+
+// Remove a flag which GTest doesn't recognize from argv, returning whether it was there.
+bool take_flag(int &argc, char **argv, std::string_view flag) {
+  auto end = std::remove_if(argv + 1, argv + argc,
+                            [&](char const *arg) { return arg == flag; });
+  bool found = end != argv + argc;
+  argc = static_cast<int>(end - argv);
+  argv[argc] = nullptr;
+  return found;
+}
+
+bool glob_matches(std::string_view pattern, std::string_view name) {
+  if (pattern.empty()) return name.empty();
+  if (pattern[0] == '*') {
+    for (size_t i = 0; i <= name.size(); ++i) {
+      if (glob_matches(pattern.substr(1), name.substr(i))) return true;
+    }
+    return false;
+  }
+  if (name.empty() or (pattern[0] != '?' and pattern[0] != name[0])) return false;
+  return glob_matches(pattern.substr(1), name.substr(1));
+}
+
+// Whether a test would be selected by --gtest_filter, which is a :-list
+// of positive patterns optionally followed by - and negative patterns.
+bool filter_selects(std::string_view suite_name, std::string_view test_name) {
+  std::string full_name{suite_name};
+  full_name += ".";
+  full_name += test_name;
+
+  std::string filter = GTEST_FLAG_GET(filter);
+  std::string_view positive = filter, negative;
+  if (auto dash = positive.find('-'); dash != std::string_view::npos) {
+    negative = positive.substr(dash + 1);
+    positive = positive.substr(0, dash);
+  }
+  auto any_matches = [&](std::string_view patterns) {
+    while (not patterns.empty()) {
+      auto pattern = patterns.substr(0, patterns.find(':'));
+      patterns.remove_prefix(std::min(pattern.size() + 1, patterns.size()));
+      if (glob_matches(pattern, full_name)) return true;
+    }
+    return false;
+  };
+  return (positive.empty() or any_matches(positive)) and not any_matches(negative);
+}
+
+export struct Main {
+  Main(int &argc, char **argv) {
+    InitGoogleTest(&argc, argv);
+    for (auto &registration : deferred_registrations) registration();
+    deferred_registrations.clear();
+    benchmarks_enabled = take_flag(argc, argv, "--benchmark");
+    if (benchmarks_enabled) {
+      for (auto &registration : deferred_benchmarks) registration();
+    }
+    deferred_benchmarks.clear();
+  }
+  int run() { return RUN_ALL_TESTS(); }
+};
+
+extern "C++" int run_tests_(int argc, char **argv) { return Main{argc, argv}.run(); }
+
+// A custom main which calls RUN_ALL_TESTS() directly would silently skip every
+// case parameterized by a Generator, so fail the run instead.
+// (A listener is used rather than an Environment, since Environments aren't set
+// up if no tests were registered.)
+struct DeferredRegistrationsCheck : testing::EmptyTestEventListener {
+  void OnTestProgramStart(testing::UnitTest const &) override {
+    if (deferred_registrations.empty()) return;
+    ADD_FAILURE() << deferred_registrations.size()
+                  << " test(s) parameterized by a Generator were not registered; "
+                     "a custom main must run tests by calling run_tests_(argc, argv) "
+                     "rather than RUN_ALL_TESTS()";
+  }
+};
+auto *const deferred_registrations_check = [] {
+  auto *check = new DeferredRegistrationsCheck;
+  testing::UnitTest::GetInstance()->listeners().Append(check);
+  return check;
+}();
+
+/// A coroutine which lazily produces parameters for :c:macro:`TEST_`.
+///
+/// .. code-block::
+///
+///   TEST_(fuzz, []() -> Generator<std::string> {
+///     for (int seed = 0; seed < 100'000; ++seed) co_yield random_input(seed);
+///   }) {
+///     EXPECT_(parse(parameter));
+///   }
+///
+/// Unlike other parameter ranges, a generator is not run during static
+/// initialization. It is run once GTest's flags have been parsed, and only the
+/// parameters of cases selected by ``--gtest_filter`` are kept. For the same
+/// reason, cases are named only by their index (``fuzz/0``, ``fuzz/1``, ...)
+/// and a parameter is only printed if its case is selected.
+///
+/// Note that the generator is still run to completion (and each case's name
+/// matched against the filter) even when only one case is selected, so a
+/// filtered run saves the cost of storing and registering the other cases but
+/// not the cost of generating them.
+export template <typename T>
+class Generator {
+ public:
+  using value_type = std::remove_cvref_t<T>;
+
+  struct promise_type {
+    value_type const *value;
+
+    Generator get_return_object() {
+      return Generator{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    std::suspend_always yield_value(value_type const &v) noexcept {
+      value = std::addressof(v);
+      return {};
+    }
+    void return_void() {}
+    void unhandled_exception() { throw; }
+  };
+
+  Generator(Generator &&other) noexcept : _handle{std::exchange(other._handle, {})} {}
+  ~Generator() {
+    if (_handle) _handle.destroy();
+  }
+
+  struct Sentinel {};
+  struct Iterator {
+    std::coroutine_handle<promise_type> handle;
+    value_type const &operator*() const { return *handle.promise().value; }
+    void operator++() { handle.resume(); }
+    bool operator!=(Sentinel) const { return not handle.done(); }
+  };
+
+  Iterator begin() {
+    _handle.resume();
+    return {_handle};
+  }
+  Sentinel end() const { return {}; }
+
+ private:
+  explicit Generator(std::coroutine_handle<promise_type> handle) : _handle{handle} {}
+  std::coroutine_handle<promise_type> _handle;
+};
+
+template <typename T>
+constexpr bool IS_GENERATOR = false;
+
+template <typename T>
+constexpr bool IS_GENERATOR<Generator<T>> = true;
 
 struct Info {
   char const *file;
   int line;
   char const *suite_name;
   char const *test_name;
+  bool benchmark = false;
 };
 
 using Body = void(void const *);
@@ -77,11 +243,19 @@ struct Registrar {
   };
 
   void register_one(auto *test, Info info, auto parameter, int i = -1,
-                    std::string type_name = "") {
+                    std::string type_name = "", bool name_parameter = true) {
     constexpr bool HAS_PARAMETER =
         not std::is_same_v<decltype(parameter), std::nullptr_t>;
 
-    auto [file, line, suite_name, test_name] = info;
+    auto [file, line, suite_name, test_name, benchmark] = info;
+    if (benchmark and not benchmarks_enabled) {
+      // (parameter points into storage which won't move, so it can be kept.)
+      deferred_benchmarks.push_back(
+          [this, test, info, parameter, i, type_name, name_parameter] {
+            register_one(test, info, parameter, i, type_name, name_parameter);
+          });
+      return;
+    }
 
     char const *type_param = nullptr;
     char const *value_param = nullptr;
@@ -94,10 +268,11 @@ struct Registrar {
       type_param = type_name.c_str();
       name += "/" + type_name;
     }
+    std::string printed;
     if constexpr (HAS_PARAMETER) {
-      auto old_size = name.size();
-      name += "/" + PrintToString(*parameter);
-      value_param = name.c_str() + old_size + 1;
+      printed = PrintToString(*parameter);
+      value_param = printed.c_str();
+      if (name_parameter) name += "/" + printed;
     }
     testing::RegisterTest(suite_name, name.c_str(), type_param, value_param, file, line,
                           [test, parameter] {
@@ -124,9 +299,35 @@ struct Registrar {
     parameters.emplace_back(std::move(vector));
   }
 
+  void register_generator(auto *test, Info info, auto make_generator) {
+    deferred_registrations.push_back([this, test, info, make_generator] {
+      using Parameter = typename decltype(make_generator())::value_type;
+      std::vector<std::pair<int, Parameter>> selected;
+      int i = 0;
+      for (auto const &parameter : make_generator()) {
+        auto name = std::string{info.test_name} + "/" + std::to_string(i);
+        if (filter_selects(info.suite_name, name)) selected.emplace_back(i, parameter);
+        ++i;
+      }
+      auto &stored = std::any_cast<decltype(selected) &>(
+          parameters.emplace_back(std::move(selected)));
+      for (auto const &[index, parameter] : stored) {
+        register_one(test, info, &parameter, index, "", /*name_parameter=*/false);
+      }
+    });
+  }
+
   void register_(auto *test, Info info, auto &&parameters) {
-    if constexpr (std::is_invocable_v<decltype(parameters)>) {
-      register_range(test, info, std::move(parameters)());
+    using P = std::decay_t<decltype(parameters)>;
+    if constexpr (IS_GENERATOR<P>) {
+      auto generator = std::make_shared<P>(std::move(parameters));
+      register_generator(test, info, [generator] { return std::move(*generator); });
+    } else if constexpr (std::is_invocable_v<P>) {
+      if constexpr (IS_GENERATOR<std::invoke_result_t<P>>) {
+        register_generator(test, info, std::move(parameters));
+      } else {
+        register_range(test, info, std::move(parameters)());
+      }
     } else {
       register_range(test, info, std::move(parameters));
     }
@@ -431,6 +632,125 @@ struct Matcher {
   void DescribeNegationTo(std::ostream *os) const { describe_negation(*os); }
 };
 
+/// Prevents the compiler from optimizing away the computation of a value.
+///
+/// In a :c:macro:`BENCHMARK_` loop, results which are otherwise unused should be
+/// passed to this function so that the work being measured is not elided.
+export template <typename T>
+void do_not_optimize(T const &value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "g"(&value) : "memory");
+#else
+  static void const *volatile sink;
+  sink = &value;
+#endif
+}
+
+/// Iteration state of a benchmark; see :c:macro:`BENCHMARK_`.
+///
+/// Iterating over a ``Benchmark`` runs the loop body in batches. Batches grow
+/// until each takes at least ``min_batch_time``; those and one more batch are
+/// discarded as warmup, then ``samples`` batches are timed.
+export class Benchmark {
+ public:
+  int samples = 20;
+  std::chrono::nanoseconds min_batch_time = std::chrono::milliseconds{10};
+
+  struct Sentinel {};
+  struct Iterator {
+    Benchmark *benchmark;
+    bool operator!=(Sentinel) const {
+      return benchmark->_remaining != 0 or benchmark->next_batch();
+    }
+    void operator++() { --benchmark->_remaining; }
+    int operator*() const { return 0; }
+  };
+
+  Iterator begin() {
+    _batch_size = _remaining = 1;
+    _calibrated = false;
+    _sample_times.clear();
+    _start = std::chrono::steady_clock::now();
+    return {this};
+  }
+  Sentinel end() const { return {}; }
+
+  /// Reports statistics of the time per iteration on stdout and as GTest
+  /// properties, which are included in ``--gtest_output=json:...`` results.
+  void report() const {
+    if (_sample_times.empty()) return;
+    auto sorted = _sample_times;
+    std::sort(sorted.begin(), sorted.end());
+    double n = static_cast<double>(sorted.size()), sum = 0, squares = 0;
+    for (double t : sorted) sum += t;
+    double mean = sum / n;
+    for (double t : sorted) squares += (t - mean) * (t - mean);
+    auto percentile = [&](double p) {
+      return sorted[static_cast<size_t>(std::ceil(p * n)) - 1];
+    };
+
+    std::pair<char const *, double> const stats[] = {
+        {"mean", mean},
+        {"min", sorted.front()},
+        {"stddev", sorted.size() > 1 ? std::sqrt(squares / (n - 1)) : 0},
+        {"p50", percentile(0.5)},
+        {"p90", percentile(0.9)},
+        {"max", sorted.back()},
+    };
+
+    auto const *info = testing::UnitTest::GetInstance()->current_test_info();
+    std::cout << "BENCHMARK " << info->test_suite_name() << "." << info->name() << "\n";
+    for (auto [name, ns] : stats) {
+      std::cout << "  " << name << "=" << format_duration(ns);
+      testing::Test::RecordProperty(std::string{name} + "_ns", std::to_string(ns));
+    }
+    std::cout << "\n  " << sorted.size() << " samples of " << _batch_size
+              << " iterations" << std::endl;
+    testing::Test::RecordProperty("samples", static_cast<int>(sorted.size()));
+    testing::Test::RecordProperty("iterations_per_sample", static_cast<int>(_batch_size));
+  }
+
+ private:
+  bool next_batch() {
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = now - _start;
+    if (_calibrated) {
+      _sample_times.push_back(std::chrono::duration<double, std::nano>(elapsed).count()
+                              / static_cast<double>(_batch_size));
+      if (static_cast<int>(_sample_times.size()) >= samples) return false;
+    } else if (elapsed < min_batch_time) {
+      // Grow the batch toward min_batch_time (by at most 10x, since early
+      // batches are the least representative).
+      double ratio = std::chrono::duration<double>(min_batch_time)
+                   / std::chrono::duration<double>(elapsed);
+      _batch_size *= static_cast<int64_t>(std::clamp(ratio * 1.2, 2.0, 10.0));
+    } else {
+      _calibrated = true;
+    }
+    _remaining = _batch_size;
+    _start = std::chrono::steady_clock::now();
+    return true;
+  }
+
+  static std::string format_duration(double ns) {
+    char const *unit = "ns";
+    for (char const *larger : {"us", "ms", "s"}) {
+      if (ns < 1000) break;
+      ns /= 1000;
+      unit = larger;
+    }
+    std::stringstream ss;
+    ss.precision(4);
+    ss << ns << unit;
+    return std::move(ss).str();
+  }
+
+  int64_t _remaining = 0, _batch_size = 1;
+  bool _calibrated = false;
+  std::chrono::steady_clock::time_point _start;
+  std::vector<double> _sample_times;
+};
+
 export struct DontTerminateIfDestructionThrows {
   ~DontTerminateIfDestructionThrows() noexcept(false) {}
 };
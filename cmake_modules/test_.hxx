@@ -48,6 +48,9 @@
 /// and incorporated into the test case’s total name along with case_name and the
 /// suite’s name to make it accessible to
 /// :gtest:`filtering <advanced.html#running-a-subset-of-the-tests>`.
+///
+/// If there are very many parameters, they can be produced lazily by a
+/// :cpp:class:`Generator` (or a function returning one) instead.
 #define TEST_(case_name, ...)                                            \
   namespace SUITE_NAME {                                                 \
   struct case_name : Registrar<struct SuiteState> {                      \
@@ -62,6 +65,64 @@
   template <typename Parameter>                                          \
   void SUITE_NAME::case_name::body(Parameter const &parameter)
 
+/// Defines and registers a benchmark with optional parameters.
+///
+/// :param case_name: The benchmark's name
+/// :param parameters: Parameters with which to parameterize the benchmark body
+///
+/// A benchmark is a test case (parameterized exactly as with :c:macro:`TEST_`)
+/// whose body contains a loop over ``benchmark``, which is declared as
+///
+/// .. cpp:var:: Benchmark &benchmark
+///
+/// Only the loop is timed, so setup can precede it. The loop body is repeated
+/// in batches: batch size is calibrated so that timer overhead is negligible,
+/// then after warmup a number of batches are timed as samples. Statistics of the
+/// time per iteration are printed and recorded as
+/// :gtest:`test properties <advanced.html#logging-additional-information>`,
+/// so they are included in the results written by ``--gtest_output=json:FILE``.
+///
+/// Benchmarks are only registered if the test executable is run with
+/// ``--benchmark``, so that ordinary test runs don't pay for them:
+///
+/// .. code-block:: shell-session
+///
+///   $ .build/Debug/test_.sorting --benchmark --gtest_filter=*sort*
+///
+/// .. code-block::
+///
+///   BENCHMARK_(sort, {1 << 10, 1 << 20}) {
+///     auto data = random_ints(parameter);
+///     benchmark.samples = 10; // defaults to 20
+///     for (auto _ : benchmark) {
+///       auto copy = data;
+///       std::sort(copy.begin(), copy.end());
+///       do_not_optimize(copy);
+///     }
+///   }
+///   // BENCHMARK sorting.sort/0/1024
+///   //   mean=10.94us  min=10.71us  stddev=211.9ns  p50=10.87us  p90=11.16us  max=11.6us
+///   //   20 samples of 1113 iterations
+#define BENCHMARK_(case_name, ...)                                               \
+  namespace SUITE_NAME {                                                         \
+  struct case_name : Registrar<struct SuiteState> {                              \
+    case_name() {                                                                \
+      register_(this, {__FILE__, __LINE__, GTEST_STRINGIFY_(SUITE_NAME),         \
+                       #case_name, true} __VA_OPT__(, ) __VA_ARGS__);            \
+    }                                                                            \
+    template <typename Parameter>                                                \
+    static void body(Parameter const &parameter) {                               \
+      Benchmark benchmark;                                                       \
+      run(parameter, benchmark);                                                 \
+      benchmark.report();                                                        \
+    }                                                                            \
+    template <typename Parameter>                                                \
+    static void run(Parameter const &parameter, Benchmark &benchmark);           \
+  } case_name;                                                                   \
+  }                                                                              \
+  template <typename Parameter>                                                  \
+  void SUITE_NAME::case_name::run(Parameter const &parameter, Benchmark &benchmark)
+
 /// Checks its condition, producing a failure if it is falsy.
 ///
 /// :param condition: An expression which is expected to be truthy.
@@ -1 +1,23 @@
 export module test_:main;
+
+// Defined by test_; initializes GTest and runs all tests.
+extern "C++" int run_tests_(int argc, char **argv);
+
+// The default main is weak so that (as when GTest::gtest_main provided it) a
+// suite which defines its own main function overrides it.
+#ifdef _MSC_VER
+// MSVC has no weak definitions, but the linker will only fall back to an
+// alternate name for main if no other definition is found.
+extern "C" int maud_default_main_(int argc, char **argv) {
+  return run_tests_(argc, argv);
+}
+#ifdef _M_IX86
+#pragma comment(linker, "/alternatename:_main=_maud_default_main_")
+#else
+#pragma comment(linker, "/alternatename:main=maud_default_main_")
+#endif
+#else
+extern "C++" [[gnu::weak]] int main(int argc, char **argv) {
+  return run_tests_(argc, argv);
+}
+#endif
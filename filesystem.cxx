@@ -1,6 +1,13 @@
 module;
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include <filesystem>
 #include <fstream>
+#include <stdexcept>
 #include <string>
 export module maud_:filesystem;
 
@@ -26,13 +33,78 @@ class Padded {
 export template <size_t N = Padded<>::PADDING>
 Padded<N> read(std::filesystem::path const &path) {
   std::ifstream stream{path};
+  if (not stream) throw std::runtime_error{"could not read " + path.string()};
   Padded<N> contents{stream.seekg(0, std::ios_base::end).tellg()};
   stream.seekg(0).read(contents.data(), contents.size());
   return contents;
 }
 
+// A read-only memory mapped file with the same guarantee of zeros for look ahead
+// and behind as Padded. Since pages are only read when they are first touched,
+// this is preferable when only a prefix of the file is usually examined.
+// (Where mapping is unavailable, the whole file is read to Padded instead.)
+export template <size_t N = Padded<>::PADDING>
+class Mapped {
+ public:
+  explicit Mapped(std::filesystem::path const &path) {
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd >= 0 and fstat(fd, &st) == 0 and S_ISREG(st.st_mode)) {
+      size_t page = sysconf(_SC_PAGESIZE);
+      static_assert(N <= 4096, "padding may not exceed the minimum page size");
+
+      // Reserve a zeroed page before the file and at least one after it,
+      // then map the file over the middle of the reservation.
+      _size = st.st_size;
+      _mapping_size = page + (_size + page - 1) / page * page + page;
+      _mapping =
+          mmap(nullptr, _mapping_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (_mapping != MAP_FAILED) {
+        char *data = static_cast<char *>(_mapping) + page;
+        if (_size == 0
+            or mmap(data, _size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0)
+                   != MAP_FAILED) {
+          _data = data;
+          close(fd);
+          return;
+        }
+        munmap(_mapping, _mapping_size);
+      }
+      _mapping = nullptr;
+    }
+    if (fd >= 0) close(fd);
+#endif
+    _fallback = read<N>(path);
+    _data = _fallback.c_str();
+    _size = _fallback.size();
+  }
+
+  Mapped(Mapped const &) = delete;
+  Mapped &operator=(Mapped const &) = delete;
+
+  ~Mapped() {
+#ifndef _WIN32
+    if (_mapping) munmap(_mapping, _mapping_size);
+#endif
+  }
+
+  size_t size() const { return _size; }
+  char const *c_str() const { return _data; }
+  operator std::string_view() const { return {c_str(), size()}; }
+
+ private:
+  char const *_data = nullptr;
+  size_t _size = 0;
+  void *_mapping = nullptr;
+  size_t _mapping_size = 0;
+  Padded<N> _fallback;
+};
+
 export std::ofstream write(std::filesystem::path const &path) {
-  std::filesystem::create_directories(path.parent_path());
+  if (path.has_parent_path()) {
+    std::filesystem::create_directories(path.parent_path());
+  }
   return std::ofstream{path};
 }
 
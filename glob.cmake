@@ -0,0 +1,40 @@
+# When building Maud itself, maud_glob is compiled with try_compile
+# (as in inject_regenerate.cmake) so that it can be used for glob
+# verification before installation.
+
+set(
+  _MAUD_GLOB
+  "${MAUD_DIR}/maud_glob"
+  CACHE INTERNAL
+  "try_compile'd maud_glob for bootstrapping Maud"
+)
+
+file(
+  WRITE "${MAUD_DIR}/maud_glob_.cxx"
+  "
+  export module maud_;
+  export import :filesystem;
+  export import :parallel;
+  export import :regex;
+  "
+)
+
+try_compile(
+  success
+  SOURCES "${dir}/maud_glob.cxx"
+  SOURCES_TYPE CXX_MODULE
+  SOURCES
+    "${MAUD_DIR}/maud_glob_.cxx"
+    "${dir}/filesystem.cxx"
+    "${dir}/parallel.cxx"
+    "${dir}/regex.cxx"
+    "${dir}/cmake_modules/executable.cxx"
+  COPY_FILE "${_MAUD_GLOB}"
+  OUTPUT_VARIABLE errors
+  CXX_STANDARD 20
+  NO_CACHE
+)
+
+if(NOT success)
+  message(FATAL_ERROR "try_compile failed: ${errors}")
+endif()
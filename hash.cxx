@@ -0,0 +1,40 @@
+// Boost Licensed
+//
+module;
+#include <cstdint>
+#include <string>
+#include <string_view>
+export module maud_:hash;
+
+// 64 bit FNV-1a; not cryptographic, just a fast key for caching.
+export class Hash {
+ public:
+  Hash &update(std::string_view bytes) {
+    for (unsigned char c : bytes) {
+      _state = (_state ^ c) * 0x100000001b3;
+    }
+    return *this;
+  }
+
+  // Update with a length prefix, so that a sequence of
+  // fields can't collide with a different split of the same bytes.
+  Hash &field(std::string_view bytes) {
+    auto size = bytes.size();
+    update({reinterpret_cast<char const *>(&size), sizeof(size)});
+    return update(bytes);
+  }
+
+  uint64_t value() const { return _state; }
+
+  std::string hex() const {
+    constexpr char DIGITS[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 0; i < 16; ++i) {
+      hex[15 - i] = DIGITS[(_state >> (i * 4)) & 0xF];
+    }
+    return hex;
+  }
+
+ private:
+  uint64_t _state = 0xcbf29ce484222325;
+};
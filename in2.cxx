@@ -1,26 +1,59 @@
 // Boost Licensed
 //
 module;
+#include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <cstdint>
+#include <functional>
 #include <iostream>
-#include <sstream>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 export module maud_:in2;
 
 import :parsing;
 
 using std::operator""s;
 
+// Compile a template to a cmake module. in2 must be null terminated.
+//
+// By default, traces of compilation are written into the compiled module as comments.
+// If source_map is provided they are written there instead, leaving the module
+// much smaller: each chunk of the template is only preceded by a one line comment
+// holding its type and the line:column range it occupies in the template. Each
+// line of the source map holds the same, prefixed by the line of the compiled
+// module (counting from first_line) at which the chunk was compiled.
+export std::string compile_in2(char const *in2);
+export void compile_in2(char const *in2, std::ostream &os,
+                        std::ostream *source_map = nullptr, size_t first_line = 1);
 export void compile_in2(std::istream &is, std::ostream &os);
 
-export std::string compile_in2(std::string in) {
-  std::stringstream is{std::move(in)}, os;
-  compile_in2(is, os);
-  return std::move(os).str();
+// Yields the value of a variable in the scope where a template is rendered,
+// or std::nullopt if it isn't defined. A lookup may throw In2Unsupported if the
+// variable's value won't be known until the template is rendered by cmake.
+export using In2Lookup = std::function<std::optional<std::string_view>(std::string_view)>;
+export struct In2Unsupported {};
+
+// Render a template directly instead of compiling it to a cmake module. This
+// is only supported for templates without command blocks whose pipelines use
+// only built-in filters; std::nullopt is returned for any other template (or
+// if rendering it would have raised a cmake error), in which case it must be
+// rendered by including its compiled module.
+// in2 must be null terminated.
+export std::optional<std::string> render_in2(char const *in2, In2Lookup const &lookup);
+
+export std::string compile_in2(std::string const &in) { return compile_in2(in.c_str()); }
+
+export std::optional<std::string> render_in2(std::string const &in,
+                                             In2Lookup const &lookup) {
+  return render_in2(in.c_str(), lookup);
 }
 
-std::ostream *os = &std::cout;
+auto const HASH_LINE = std::string(82, '#') + "\n";
 
 auto find_end_of_quoted_string(auto str) {
   assert(*str == '"');
@@ -61,53 +94,6 @@ auto find_end_of_string(auto str) {
   return *str == '"' ? find_end_of_quoted_string(str) : find_end_of_block_string(str);
 }
 
-auto literal(auto begin) {
-  auto end = begin;
-  std::string bracket_fill;
-
-  while (true) {
-    end = find_first(OF<
-                         // A literal chunk is always ended by @.
-                         '@',
-                         // A closing bracket followed by zero or more
-                         // equals might require expanding the string's
-                         // bracket.
-                         ']'>,
-                     end);
-
-    if (*end != ']') break;
-
-    auto bracket = end++;
-    end = find_first(not OF<'='>, end);
-    if (*end != ']' and *end != '@') continue;
-
-    // `Hello ]=] ` ->
-    // `render([=[Hello ]=] ]=])`
-    //                  ^^^ oops not the end I want.
-    //
-    // `Hello ]=@` ->
-    // `render([=[Hello ]=]=])`
-    //                  ^^^ oops not the end I want.
-    //
-    // `Hello ]=  ` ->
-    // `render([=[Hello ]=  ]=])`
-    //                  ^^ it's fine that's not an end.
-    size_t len = &*end - &*bracket;
-    if (bracket_fill.size() >= len) continue;
-
-    bracket_fill.resize(len, '=');
-  }
-
-  // Don't bother rendering an empty literal.
-  if (begin == end) return end;
-
-  debug("literal", begin, end);
-
-  *os << "render([" << bracket_fill << "[" << (*begin == '\n' ? "\n" : "")
-      << begin.view_to(end) << ']' << bracket_fill << "])\n";
-  return end;
-}
-
 auto skipping_strings_find_first(auto real_end, auto str) {
   while (true) {
     str = find_first(real_end or OF<'[', '"'>, str);
@@ -121,128 +107,666 @@ auto skipping_strings_find_first(auto real_end, auto str) {
   }
 }
 
-auto pipeline(auto begin, auto end) {
-  debug("pipeline init", begin, end);
-  *os << "set(IT ";
-  reference(begin);
-  *os << ")\n";
+// Compiles a template to a cmake module. Output is accumulated in a buffer which
+// is flushed to the sink (if there is one) whenever it grows large, so that a
+// large template needn't be held in memory twice.
+class Compiler {
+ public:
+  explicit Compiler(std::ostream *sink = nullptr, std::ostream *source_map = nullptr,
+                    size_t first_line = 1)
+      : _sink{sink}, _source_map{source_map}, _line{first_line} {}
+
+  // in2 is assumed to be null terminated
+  void compile(char const *in2) {
+    LineIndex index{in2};
+    compile(Location{in2, index});
+    if (_sink) _sink->write(_out.data(), _out.size());
+    if (_source_map) _source_map->write(_map.data(), _map.size());
+  }
 
-  int depth = 0;
-  while (true) {
-    ++end;
-    begin = find_first(not SPACE, end);
-    // Find the end of the pipeline or the next filter
-    end = skipping_strings_find_first(OF<'@', '|'>, begin);
-
-    if (std::string_view v{&*begin, &*end}; v == "foreach") {
-      debug("pipeline foreach", begin, end);
-      *os << "set(foreach_IT_" << depth << ")\nforeach(IT ${IT})\n";
-      ++depth;
-    } else if (v == "endforeach") {
-      debug("pipeline endforeach", begin, end);
-      *os << "list(APPEND foreach_IT_" << depth << " \"${IT}\")\nendforeach()\n"
-          << "set(IT \"${foreach_IT_" << depth << "}\")\n";
-      --depth;
-    } else {
-      debug("pipeline filter", begin, end);
-      *os << "in2_pipeline_filter_" << begin.view_to(end) << "\n";
-    }
-
-    if (*end != '|') break;
-  }
-  // TODO assert depth == 0
-
-  debug("pipeline output", end, end);
-  *os << "render(\"${IT}\")\n";
-  if (*end == 0) return end;
-  return ++end;
-}
+  std::string take() && { return std::move(_out); }
+
+ private:
+  static constexpr size_t FLUSH_SIZE = 1 << 16;
+
+  void emit(auto const &...pieces) {
+    auto append = [&](auto const &piece) {
+      if constexpr (std::is_integral_v<std::decay_t<decltype(piece)>>
+                    and not std::is_same_v<std::decay_t<decltype(piece)>, char>) {
+        _out += std::to_string(piece);
+      } else {
+        _out += piece;
+      }
+    };
+    (append(pieces), ...);
+  }
 
-void reference(auto begin) {
-  begin = find_first(not SPACE, begin);
-  auto end = find_first(SPACE or OF<'@', '|'>, begin);
-  *os << "\"${" << begin.view_to(end) << "}\"";
-}
+  void maybe_flush() {
+    if (not _sink or _out.size() < FLUSH_SIZE) return;
+    count_lines();
+    _sink->write(_out.data(), _out.size());
+    _out.clear();
+    _counted = 0;
+  }
 
-auto const HASH_LINE = std::string(82, '#') + "\n";
+  void count_lines() {
+    _line += std::count(_out.begin() + _counted, _out.end(), '\n');
+    _counted = _out.size();
+  }
+
+  auto literal(auto begin) {
+    auto end = begin;
+    std::string bracket_fill;
+
+    while (true) {
+      end = find_first(OF<
+                           // A literal chunk is always ended by @.
+                           '@',
+                           // A closing bracket followed by zero or more
+                           // equals might require expanding the string's
+                           // bracket.
+                           ']'>,
+                       end);
+
+      if (*end != ']') break;
+
+      auto bracket = end++;
+      end = find_first(not OF<'='>, end);
+      if (*end != ']' and *end != '@') continue;
+
+      // `Hello ]=] ` ->
+      // `render([=[Hello ]=] ]=])`
+      //                  ^^^ oops not the end I want.
+      //
+      // `Hello ]=@` ->
+      // `render([=[Hello ]=]=])`
+      //                  ^^^ oops not the end I want.
+      //
+      // `Hello ]=  ` ->
+      // `render([=[Hello ]=  ]=])`
+      //                  ^^ it's fine that's not an end.
+      size_t len = &*end - &*bracket;
+      if (bracket_fill.size() >= len) continue;
+
+      bracket_fill.resize(len, '=');
+    }
+
+    // Don't bother rendering an empty literal.
+    if (begin == end) return end;
 
-void debug(auto type, Location begin, Location end) {
-  *os << "\n# " << type << " " << begin.line_column() << "-" << end.line_column() << "\n"
-      << HASH_LINE  //
-      << "# " << begin.view_line() << "\n";
+    debug("literal", begin, end);
 
-  if (begin.line == end.line) {
-    *os << "# " << std::string(begin.column, ' ');
-    if (int len = end.column - begin.column; len >= 2) {
-      *os << '^' << std::string(len - 2, '~');
+    emit("render([", bracket_fill, "[", (*begin == '\n' ? "\n" : ""), begin.view_to(end),
+         ']', bracket_fill, "])\n");
+    return end;
+  }
+
+  auto pipeline(auto begin, auto end) {
+    debug("pipeline init", begin, end);
+    emit("set(IT ");
+    reference(begin);
+    emit(")\n");
+
+    int depth = 0;
+    while (true) {
+      ++end;
+      begin = find_first(not SPACE, end);
+      // Find the end of the pipeline or the next filter
+      end = skipping_strings_find_first(OF<'@', '|'>, begin);
+
+      if (std::string_view v{&*begin, &*end}; v == "foreach") {
+        debug("pipeline foreach", begin, end);
+        emit("set(foreach_IT_", depth, ")\nforeach(IT ${IT})\n");
+        ++depth;
+      } else if (v == "endforeach") {
+        debug("pipeline endforeach", begin, end);
+        emit("list(APPEND foreach_IT_", depth, " \"${IT}\")\nendforeach()\n",
+             "set(IT \"${foreach_IT_", depth, "}\")\n");
+        --depth;
+      } else {
+        debug("pipeline filter", begin, end);
+        emit("in2_pipeline_filter_", begin.view_to(end), "\n");
+      }
+
+      if (*end != '|') break;
     }
-    *os << "^\n" << HASH_LINE;
-    return;
+    // TODO assert depth == 0
+
+    debug("pipeline output", end, end);
+    emit("render(\"${IT}\")\n");
+    if (*end == 0) return end;
+    return ++end;
   }
 
-  *os << "# " << std::string(begin.column, ' ') << '^'
-      << std::string(begin.view_line().size() - begin.column, '~') << "\n#"
-      << std::string(end.column, '~') << "v\n# " << end.view_line() << "\n"
-      << HASH_LINE;
-}
+  void reference(auto begin) {
+    begin = find_first(not SPACE, begin);
+    auto end = find_first(SPACE or OF<'@', '|'>, begin);
+    emit("\"${", begin.view_to(end), "}\"");
+  }
 
-// str is assumed to be null terminated
-void compile(auto begin) {
-  if (*begin == 0) return;
+  void debug(char const *type, Location begin, Location end) {
+    if (_source_map) {
+      // Only a single line comment is kept, so that the line in a cmake error
+      // can still be read back to a template location without the map.
+      emit("# ", type, " ", begin.line_column(), "-", end.line_column(), "\n");
+      count_lines();
+      _map += std::to_string(_line) + " " + type + " " + begin.line_column() + "-"
+            + end.line_column() + "\n";
+      return;
+    }
 
-  // we always start with a literal chunk
-LITERAL:
-  auto end = literal(begin);
-  if (*end == 0) return;
+    emit("\n# ", type, " ", begin.line_column(), "-", end.line_column(), "\n", HASH_LINE,
+         "# ", begin.view_line(), "\n");
+
+    auto begin_column = begin.column(), end_column = end.column();
+    if (begin.line() == end.line()) {
+      emit("# ", std::string(begin_column, ' '));
+      if (int64_t len = int64_t{end_column} - begin_column; len >= 2) {
+        emit('^', std::string(len - 2, '~'));
+      }
+      emit("^\n", HASH_LINE);
+      return;
+    }
 
-  // skip past the @
-  begin = ++end;
+    emit("# ", std::string(begin_column, ' '), '^',
+         std::string(begin.view_line().size() - begin_column, '~'), "\n#",
+         std::string(end_column, '~'), "v\n# ", end.view_line(), "\n", HASH_LINE);
+  }
 
-  // check for @@, in which case we resume with a
-  // new literal
-  if (*begin == '@') {
-    debug("@@ -> @", begin, begin);
-    *os << "render(\"@\")\n";
-    ++begin;
+  void compile(Location begin) {
     if (*begin == 0) return;
-    goto LITERAL;
-  }
 
-  // Now we have a var ref, a command block, or
-  // a pipe.
-  end = find_first(OF<
-                       // The block ends with @.
-                       '@',
-                       // A '(' indicates a command.
-                       '(',
-                       // A '|' indicates a pipeline.
-                       '|'>,
-                   begin);
-  if (*end == '@' or *end == 0) {
-    debug("reference", begin, end);
-    *os << "render(";
-    reference(begin);
-    *os << ")\n";
+    // we always start with a literal chunk
+  LITERAL:
+    maybe_flush();
+    auto end = literal(begin);
     if (*end == 0) return;
-    begin = ++end;
-    goto LITERAL;
-  }
 
-  if (*end == '(') {
-    end = skipping_strings_find_first(OF<'@'>, end);
-    debug("commands", begin, end);
-    *os << begin.view_to(end) << "\n";
-    if (*end == 0) return;
+    // skip past the @
     begin = ++end;
+
+    // check for @@, in which case we resume with a
+    // new literal
+    if (*begin == '@') {
+      debug("@@ -> @", begin, begin);
+      emit("render(\"@\")\n");
+      ++begin;
+      if (*begin == 0) return;
+      goto LITERAL;
+    }
+
+    // Now we have a var ref, a command block, or
+    // a pipe.
+    end = find_first(OF<
+                         // The block ends with @.
+                         '@',
+                         // A '(' indicates a command.
+                         '(',
+                         // A '|' indicates a pipeline.
+                         '|'>,
+                     begin);
+    if (*end == '@' or *end == 0) {
+      debug("reference", begin, end);
+      emit("render(");
+      reference(begin);
+      emit(")\n");
+      if (*end == 0) return;
+      begin = ++end;
+      goto LITERAL;
+    }
+
+    if (*end == '(') {
+      end = skipping_strings_find_first(OF<'@'>, end);
+      debug("commands", begin, end);
+      emit(begin.view_to(end), "\n");
+      if (*end == 0) return;
+      begin = ++end;
+      goto LITERAL;
+    }
+
+    begin = pipeline(begin, end);
     goto LITERAL;
   }
 
-  begin = pipeline(begin, end);
-  goto LITERAL;
+  std::ostream *_sink, *_source_map;
+  std::string _out, _map;
+  // The line of the compiled module at _out[_counted]
+  size_t _line, _counted = 0;
+};
+
+std::string compile_in2(char const *in2) {
+  Compiler compiler;
+  compiler.compile(in2);
+  return std::move(compiler).take();
+}
+
+void compile_in2(char const *in2, std::ostream &os, std::ostream *source_map,
+                 size_t first_line) {
+  Compiler{&os, source_map, first_line}.compile(in2);
 }
 
 void compile_in2(std::istream &is, std::ostream &os) {
   std::string in2(std::istreambuf_iterator{is}, {});
-  ::os = &os;
-  compile(Location{in2.c_str()});
+  compile_in2(in2.c_str(), os);
+}
+
+// An interpreter for the cmake code which compile() would produce for a template,
+// restricted to what a template without command blocks can generate.
+class NativeRenderer {
+ public:
+  using Unsupported = In2Unsupported;
+
+  explicit NativeRenderer(In2Lookup const &lookup) : _lookup{lookup} {}
+
+  // Mirrors compile()
+  std::string render(char const *begin) {
+    std::string out;
+    while (*begin != 0) {
+      auto end = find_first(OF<'@'>, begin);
+      out.append(begin, end);
+      if (*end == 0) break;
+
+      begin = ++end;
+      if (*begin == '@') {
+        out += '@';
+        ++begin;
+        continue;
+      }
+
+      end = find_first(OF<'@', '(', '|'>, begin);
+      if (*end == '@' or *end == 0) {
+        out += reference(begin);
+        if (*end == 0) break;
+        begin = ++end;
+        continue;
+      }
+
+      if (*end == '(') throw Unsupported{};
+      begin = pipeline(begin, end, out);
+    }
+    return out;
+  }
+
+ private:
+  std::string get(std::string const &name) const {
+    if (auto it = _locals.find(name); it != _locals.end()) return it->second;
+    if (auto value = _lookup(name)) return std::string{*value};
+    return "";
+  }
+
+  static bool is_name_char(char c) {
+    return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9')
+        or c == '/' or c == '_' or c == '.' or c == '+' or c == '-';
+  }
+
+  // Expand escape sequences and variable references as in a quoted argument.
+  // \; and @VAR@ (which older policies would expand) are not supported.
+  std::string expand(std::string_view text) const {
+    std::string out;
+    size_t i = 0;
+    while (i < text.size()) {
+      char c = text[i];
+      if (c == '@') throw Unsupported{};
+      if (c == '\\') {
+        if (++i == text.size()) throw Unsupported{};
+        switch (c = text[i++]) {
+          case 'n':
+            out += '\n';
+            break;
+          case 't':
+            out += '\t';
+            break;
+          case 'r':
+            out += '\r';
+            break;
+          default:
+            if (c == ';' or std::isalnum(static_cast<unsigned char>(c))) {
+              throw Unsupported{};
+            }
+            out += c;
+        }
+        continue;
+      }
+      if (c == '$' and text.substr(i + 1).starts_with('{')) {
+        i += 2;
+        out += get(expand_name(text, i));
+        continue;
+      }
+      if (c == '$') {
+        // $ENV{...} and $CACHE{...} aren't supported
+        auto j = i + 1;
+        while (j < text.size() and text[j] >= 'A' and text[j] <= 'Z') ++j;
+        if (j != i + 1 and j < text.size() and text[j] == '{') throw Unsupported{};
+      }
+      out += c;
+      ++i;
+    }
+    return out;
+  }
+
+  // Read a variable name (which may itself contain references) up to its closing }.
+  std::string expand_name(std::string_view text, size_t &i) const {
+    std::string name;
+    while (true) {
+      if (i == text.size()) throw Unsupported{};
+      char c = text[i];
+      if (c == '}') {
+        ++i;
+        return name;
+      }
+      if (c == '$' and text.substr(i + 1).starts_with('{')) {
+        i += 2;
+        name += get(expand_name(text, i));
+        continue;
+      }
+      if (not is_name_char(c)) throw Unsupported{};
+      name += c;
+      ++i;
+    }
+  }
+
+  // Mirrors reference()
+  std::string reference(char const *begin) const {
+    begin = find_first(not SPACE, begin);
+    auto end = find_first(SPACE or OF<'@', '|'>, begin);
+    return expand("${" + std::string{begin, end} + "}");
+  }
+
+  // Split a list, as an unquoted argument would be if `drop_empty` or as list()
+  // would otherwise. Bracket and escape handling isn't supported.
+  static std::vector<std::string> split(std::string_view list, bool drop_empty) {
+    if (list.find_first_of("[]\\") != std::string_view::npos) throw Unsupported{};
+    std::vector<std::string> elements;
+    if (list.empty()) return elements;
+    while (true) {
+      auto semicolon = list.find(';');
+      auto element = list.substr(0, semicolon);
+      if (not element.empty() or not drop_empty) elements.emplace_back(element);
+      if (semicolon == std::string_view::npos) return elements;
+      list.remove_prefix(semicolon + 1);
+    }
+  }
+
+  static std::string join(std::vector<std::string> const &elements,
+                          std::string_view glue) {
+    std::string joined;
+    for (auto const &element : elements) {
+      if (&element != &elements.front()) joined += glue;
+      joined += element;
+    }
+    return joined;
+  }
+
+  // Parse `name(args...)`, evaluating the arguments.
+  std::vector<std::string> parse_call(std::string_view text, std::string &name) const {
+    size_t i = 0;
+    while (i < text.size() and (is_name_char(text[i]) and text[i] != '/')) ++i;
+    name = text.substr(0, i);
+    auto skip_space = [&] {
+      while (i < text.size() and SPACE(text[i])) ++i;
+    };
+    skip_space();
+    if (name.empty() or i == text.size() or text[i++] != '(') throw Unsupported{};
+
+    std::vector<std::string> args;
+    while (true) {
+      skip_space();
+      if (i == text.size()) throw Unsupported{};
+      char c = text[i];
+      if (c == ')') break;
+      if (c == '#' or c == '(') throw Unsupported{};
+
+      if (c == '"') {
+        auto close = i + 1;
+        while (close < text.size() and text[close] != '"') {
+          close += text[close] == '\\' ? 2 : 1;
+        }
+        if (close >= text.size()) throw Unsupported{};
+        args.push_back(expand(text.substr(i + 1, close - i - 1)));
+        i = close + 1;
+        continue;
+      }
+
+      if (c == '[') {
+        auto equals = text.find_first_not_of('=', i + 1);
+        if (equals == std::string_view::npos or text[equals] != '[') throw Unsupported{};
+        auto close = "]" + std::string(equals - i - 1, '=') + "]";
+        auto content_end = text.find(close, equals + 1);
+        if (content_end == std::string_view::npos) throw Unsupported{};
+        auto content = text.substr(equals + 1, content_end - equals - 1);
+        if (content.starts_with('\r')) throw Unsupported{};
+        if (content.starts_with('\n')) content.remove_prefix(1);
+        args.emplace_back(content);
+        i = content_end + close.size();
+        continue;
+      }
+
+      auto end = i;
+      while (end < text.size() and not SPACE(text[end]) and text[end] != ')') ++end;
+      auto unquoted = text.substr(i, end - i);
+      if (unquoted.find_first_of("\"#([]\\") != std::string_view::npos) {
+        throw Unsupported{};
+      }
+      for (auto &arg : split(expand(unquoted), true)) args.push_back(std::move(arg));
+      i = end;
+    }
+
+    ++i;
+    skip_space();
+    if (i != text.size()) throw Unsupported{};
+    return args;
+  }
+
+  // if(IT) is true unless IT's value is a false constant.
+  static bool is_truthy(std::string_view value) {
+    auto is = [&](std::string_view constant) {
+      if (value.size() != constant.size()) return false;
+      for (size_t i = 0; i < value.size(); ++i) {
+        char c = value[i];
+        if (c >= 'a' and c <= 'z') c -= 'a' - 'A';
+        if (c != constant[i]) return false;
+      }
+      return true;
+    };
+    return not(value.empty() or is("0") or is("N") or is("NO") or is("OFF")
+               or is("FALSE") or is("IGNORE") or value == "NOTFOUND"
+               or value.ends_with("-NOTFOUND"));
+  }
+
+  // As string(JSON) would escape a string.
+  static std::string escape(std::string_view str) {
+    constexpr char DIGITS[] = "0123456789abcdef";
+    std::string escaped;
+    for (unsigned char c : str) {
+      switch (c) {
+        case '"':
+          escaped += "\\\"";
+          break;
+        case '\\':
+          escaped += "\\\\";
+          break;
+        case '\b':
+          escaped += "\\b";
+          break;
+        case '\f':
+          escaped += "\\f";
+          break;
+        case '\n':
+          escaped += "\\n";
+          break;
+        case '\r':
+          escaped += "\\r";
+          break;
+        case '\t':
+          escaped += "\\t";
+          break;
+        default:
+          // Non-ASCII characters would be escaped by code point
+          if (c >= 0x80) throw Unsupported{};
+          if (c < 0x20) {
+            escaped += "\\u00";
+            escaped += DIGITS[c >> 4];
+            escaped += DIGITS[c & 0xF];
+          } else {
+            escaped += static_cast<char>(c);
+          }
+      }
+    }
+    return escaped;
+  }
+
+  // Mirrors the built-in in2_pipeline_filter_* functions
+  void filter(std::string_view text) {
+    std::string name;
+    auto args = parse_call(text, name);
+    auto &it = _locals["IT"];
+
+    if (name == "set") {
+      it = join(args, ";");
+      return;
+    }
+
+    if (name == "if_else") {
+      if (args.size() < 2) throw Unsupported{};
+      it = is_truthy(it) ? args[0] : args[1];
+      return;
+    }
+
+    if (name == "join") {
+      if (args.empty()) throw Unsupported{};
+      it = join(split(it, false), args[0]);
+      return;
+    }
+
+    if (name == "string") {
+      if (args.empty()) throw Unsupported{};
+      auto const &mode = args[0];
+      if (mode == "TOLOWER" or mode == "TOUPPER") {
+        for (char &c : it) {
+          if (mode == "TOLOWER" and c >= 'A' and c <= 'Z') c += 'a' - 'A';
+          if (mode == "TOUPPER" and c >= 'a' and c <= 'z') c -= 'a' - 'A';
+        }
+      } else if (mode == "STRIP") {
+        auto is_space = [](char c) { return c == ' ' or (c >= '\t' and c <= '\r'); };
+        size_t begin = 0, end = it.size();
+        while (begin < end and is_space(it[begin])) ++begin;
+        while (end > begin and is_space(it[end - 1])) --end;
+        it = it.substr(begin, end - begin);
+      } else if (mode == "MAKE_C_IDENTIFIER") {
+        for (char &c : it) {
+          if (not is_name_char(c) or c == '/' or c == '.' or c == '+' or c == '-') {
+            c = '_';
+          }
+        }
+        if (not it.empty() and it[0] >= '0' and it[0] <= '9') it = "_" + it;
+      } else if (mode == "HEX") {
+        constexpr char DIGITS[] = "0123456789abcdef";
+        std::string hex;
+        for (unsigned char c : it) {
+          hex += DIGITS[c >> 4];
+          hex += DIGITS[c & 0xF];
+        }
+        it = std::move(hex);
+      } else if (mode == "REPLACE" and args.size() == 3 and not args[1].empty()
+                 and (args[1] + args[2]).find(';') == std::string::npos) {
+        std::string replaced;
+        for (size_t i = 0;;) {
+          auto match = it.find(args[1], i);
+          replaced += it.substr(i, match - i);
+          if (match == std::string::npos) break;
+          replaced += args[2];
+          i = match + args[1].size();
+        }
+        it = std::move(replaced);
+      } else {
+        throw Unsupported{};
+      }
+      return;
+    }
+
+    if (name == "string_literal") {
+      if (args.empty() or args[0] != "RAW") {
+        it = '"' + escape(it) + '"';
+        return;
+      }
+      // Lengthen the delimiter until `)delimiter"` doesn't appear in the string.
+      std::string tag;
+      while (true) {
+        size_t match = std::string::npos;
+        for (auto paren = it.find(')'); paren != std::string::npos;
+             paren = it.find(')', paren + 1)) {
+          if (it.compare(paren + 1, tag.size(), tag) != 0) continue;
+          auto end = it.find_first_not_of('_', paren + 1 + tag.size());
+          if (end != std::string::npos and it[end] == '"') {
+            match = paren;
+            tag = it.substr(paren + 1, end - paren - 1) + "_";
+            break;
+          }
+        }
+        if (match == std::string::npos) break;
+      }
+      it = "R\"" + tag + "(" + it + ")" + tag + "\"";
+      return;
+    }
+
+    throw Unsupported{};
+  }
+
+  // Mirrors pipeline()
+  char const *pipeline(char const *begin, char const *end, std::string &out) {
+    _locals["IT"] = reference(begin);
+
+    std::vector<std::string_view> filters;
+    while (true) {
+      ++end;
+      begin = find_first(not SPACE, end);
+      end = skipping_strings_find_first(OF<'@', '|'>, begin);
+      filters.emplace_back(begin, end);
+      if (*end != '|') break;
+    }
+
+    for (size_t i = 0; i < filters.size(); ++i) {
+      if (filters[i] == "endforeach") throw Unsupported{};
+      if (filters[i] != "foreach") {
+        filter(filters[i]);
+        continue;
+      }
+
+      // compile() accumulates into foreach_IT_1 (which is never cleared), so
+      // the same is done here.
+      auto endforeach = i + 1;
+      while (endforeach < filters.size() and filters[endforeach] != "endforeach") {
+        if (filters[endforeach] == "foreach") throw Unsupported{};
+        ++endforeach;
+      }
+      if (endforeach == filters.size()) throw Unsupported{};
+
+      _locals.erase("foreach_IT_0");
+      auto accumulated = get("foreach_IT_1");
+      for (auto &element : split(get("IT"), true)) {
+        _locals["IT"] = std::move(element);
+        for (auto j = i + 1; j < endforeach; ++j) filter(filters[j]);
+        if (not accumulated.empty()) accumulated += ';';
+        accumulated += _locals["IT"];
+      }
+      _locals["foreach_IT_1"] = accumulated;
+      _locals["IT"] = std::move(accumulated);
+      i = endforeach;
+    }
+
+    out += _locals["IT"];
+    if (*end == 0) return end;
+    return ++end;
+  }
+
+  In2Lookup const &_lookup;
+  std::unordered_map<std::string, std::string> _locals;
+};
+
+std::optional<std::string> render_in2(char const *in2, In2Lookup const &lookup) {
+  try {
+    return NativeRenderer{lookup}.render(in2);
+  } catch (NativeRenderer::Unsupported) {
+    return std::nullopt;
+  }
 }
@@ -1,8 +1,11 @@
 module;
 #include <filesystem>
 #include <iostream>
+#include <optional>
+#include <sstream>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 module test_;
 
 import maud_;
@@ -23,22 +26,45 @@ TEST_(compilation, CASES) {
   write(TEST_DIR / name + ".e.in2.cmake"s) << expected_compiled;
 }
 
+TEST_(source_map) {
+  std::stringstream compiled, source_map;
+  compile_in2("a\n@FOO@ x\n@message(FATAL_ERROR boom)@", compiled, &source_map);
+  EXPECT_(compiled.str() >>= Not(HasSubstr("##")));
+  EXPECT_(compiled.str() >>= HasSubstr("# reference 2:2-2:5\nrender("));
+  EXPECT_(source_map.str() >>= HasSubstr("5 reference 2:2-2:5\n"));
+  EXPECT_(source_map.str() >>= HasSubstr("10 commands 3:2-3:27\n"));
+}
+
+TEST_(native_rendering_unsupported_lookup) {
+  auto lookup = [](std::string_view name) -> std::optional<std::string_view> {
+    if (name == "LATER") throw In2Unsupported{};
+    return "now";
+  };
+  EXPECT_(render_in2("@NOW@"s, lookup) == "now");
+  EXPECT_(not render_in2("@NOW@ @LATER@"s, lookup));
+}
+
 TEST_(rendering, CASES) {
   auto name = parameter.name();
   auto in2 = to_view(parameter["template"]);
 
   std::string definitions;
+  std::unordered_map<std::string_view, std::string_view> variables;
   if (parameter.has_child("definitions")) {
     for (auto definition : parameter["definitions"]) {
       auto value = to_view(definition);
       auto name = value.substr(0, value.find_first_of('='));
       value = value.substr(name.size() + 1);
       definitions += "set("s + name + " [======[\n"s + value + "]======])\n"s;
+      variables[name] = value;
     }
   }
   auto compiled_path = TEST_DIR / name + ".in2.cmake"s;
-  write(compiled_path) << definitions << "include(Maud)\n"
-                       << compile_in2(std::string(in2));
+  write(compiled_path) << compile_in2(std::string(in2));
+
+  auto render_path = TEST_DIR / name + ".render.cmake"s;
+  write(render_path) << definitions << "include(Maud)\n"
+                     << "_maud_render(\"" << compiled_path.generic_string() << "\")\n";
 
   auto rendered_path = TEST_DIR / name;
   write(rendered_path) << "";
@@ -48,11 +74,20 @@ TEST_(rendering, CASES) {
   auto cmd = "cmake"s;
   cmd += " -DRENDER_FILE=\"" + rendered_path.string() + "\"";
   cmd += " -DCMAKE_MODULE_PATH=\"" + (DIR / "cmake_modules").string() + "\"";
-  cmd += " -P \"" + compiled_path.string() + "\"";
+  cmd += " -P \"" + render_path.string() + "\"";
 
   if (parameter.has_child("rendered")) {
     if (not EXPECT_(std::system(cmd.c_str()) == 0)) return;
     EXPECT_(read(rendered_path) == to_view(parameter["rendered"]));
+
+    // If the template can be rendered natively, that must agree with cmake.
+    auto native = render_in2(std::string(in2), [&](std::string_view name) {
+      auto it = variables.find(name);
+      return it == variables.end() ? std::nullopt : std::optional{it->second};
+    });
+    if (native) {
+      EXPECT_(*native == to_view(parameter["rendered"]));
+    }
   }
 
   if (parameter.has_child("render error")) {
@@ -0,0 +1,620 @@
+// Boost Licensed
+//
+module;
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+module executable;
+
+import maud_;
+
+namespace fs = std::filesystem;
+
+struct Entry {
+  std::string path;
+  bool is_directory;
+};
+
+#ifdef __linux__
+// glibc doesn't declare the record which getdents64 fills. (Nor are the d_type
+// constants borrowed from dirent.h, since its DIR would clash with maud_'s.)
+struct LinuxDirent64 {
+  static constexpr unsigned char UNKNOWN = 0, DIRECTORY = 4;
+
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[1];
+};
+
+class Root {
+ public:
+  explicit Root(fs::path const &path)
+      : _fd{open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)} {}
+  Root(Root const &) = delete;
+  ~Root() {
+    if (_fd >= 0) close(_fd);
+  }
+
+  // Append the entries of dir (relative to the root) which aren't hidden.
+  // Unreadable directories are skipped, as file(GLOB_RECURSE) does.
+  void list(std::string const &dir, std::vector<Entry> &entries) const {
+    if (_fd < 0) return;
+    int fd = openat(_fd, dir.empty() ? "." : dir.c_str(),
+                    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    alignas(LinuxDirent64) char buffer[1 << 15];
+    while (true) {
+      long size = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+      if (size <= 0) break;
+      for (long offset = 0; offset < size;) {
+        auto *d = reinterpret_cast<LinuxDirent64 *>(buffer + offset);
+        offset += d->d_reclen;
+        // This also skips . and ..
+        if (d->d_name[0] == '.') continue;
+
+        bool is_directory = d->d_type == LinuxDirent64::DIRECTORY;
+        if (d->d_type == LinuxDirent64::UNKNOWN) {
+          struct stat st;
+          is_directory = fstatat(fd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0
+                     and S_ISDIR(st.st_mode);
+        }
+        auto path = dir.empty() ? std::string{d->d_name} : dir + "/" + d->d_name;
+        entries.push_back({std::move(path), is_directory});
+      }
+    }
+    close(fd);
+  }
+
+ private:
+  int _fd;
+};
+#else
+class Root {
+ public:
+  explicit Root(fs::path const &path) : _path{path} {}
+
+  void list(std::string const &dir, std::vector<Entry> &entries) const {
+    std::error_code ec;
+    fs::directory_iterator it{_path / dir, ec}, end;
+    for (; not ec and it != end; it.increment(ec)) {
+      auto name = it->path().filename().generic_string();
+      if (name.starts_with(".")) continue;
+      // Symlinked directories are listed but not followed.
+      bool is_directory = it->is_directory(ec) and not it->is_symlink(ec);
+      auto path = dir.empty() ? name : dir + "/" + name;
+      entries.push_back({std::move(path), is_directory});
+    }
+  }
+
+ private:
+  fs::path _path;
+};
+#endif
+
+// Match a .gitignore pattern against a path. As with git's wildmatch, `*` and `?`
+// don't match `/` while `**/`, `/**/`, and a trailing `/**` match any number
+// of directories.
+bool wildmatch(char const *p, char const *pe, char const *s, char const *se) {
+  while (p != pe) {
+    if (*p == '*') {
+      if (p + 1 != pe and p[1] == '*') {
+        if (p + 2 == pe) return true;
+        if (p[2] == '/') {
+          // `**/` only matches whole directories, so the rest of the pattern
+          // is tried at the start of s and just after each `/` in it.
+          p += 3;
+          for (char const *t = s;; ++t) {
+            if (wildmatch(p, pe, t, se)) return true;
+            while (t != se and *t != '/') ++t;
+            if (t == se) return false;
+          }
+        }
+        // Otherwise `**` is an ordinary `*`
+        ++p;
+      }
+      ++p;
+      for (char const *t = s;; ++t) {
+        if (wildmatch(p, pe, t, se)) return true;
+        if (t == se or *t == '/') return false;
+      }
+    }
+
+    if (s == se) return false;
+
+    if (*p == '[') {
+      char const *q = p + 1;
+      bool negated = q != pe and (*q == '!' or *q == '^');
+      if (negated) ++q;
+      bool matched = false;
+      char const *first = q;
+      for (; q != pe and (*q != ']' or q == first); ++q) {
+        if (q + 2 < pe and q[1] == '-' and q[2] != ']') {
+          matched |= q[0] <= *s and *s <= q[2];
+          q += 2;
+        } else {
+          matched |= *q == *s;
+        }
+      }
+      if (q != pe) {
+        if (matched == negated or *s == '/') return false;
+        p = q + 1;
+        ++s;
+        continue;
+      }
+      // An unterminated [ is literal
+    }
+
+    if (*p == '\\' and p + 1 != pe) ++p;
+    if (*p == '?' ? *s == '/' : *p != *s) return false;
+    ++p;
+    ++s;
+  }
+  return s == se;
+}
+
+struct IgnorePattern {
+  std::string glob;
+  bool negated = false, directory_only = false, anchored = false;
+
+  static std::optional<IgnorePattern> parse(std::string_view line) {
+    if (line.ends_with('\r')) line.remove_suffix(1);
+    while (line.ends_with(' ') and not line.ends_with("\\ ")) line.remove_suffix(1);
+    if (line.empty() or line.starts_with('#')) return std::nullopt;
+
+    IgnorePattern pattern;
+    if (line.starts_with('!')) {
+      pattern.negated = true;
+      line.remove_prefix(1);
+    }
+    if (line.ends_with('/')) {
+      pattern.directory_only = true;
+      line.remove_suffix(1);
+    }
+    pattern.anchored = line.find('/') != std::string_view::npos;
+    if (line.starts_with('/')) line.remove_prefix(1);
+    pattern.glob = line;
+    return pattern;
+  }
+};
+
+// The patterns from one exclude file; path is relative to the directory containing it.
+struct IgnoreLayer {
+  std::shared_ptr<IgnoreLayer const> parent;
+  std::string base;
+  std::vector<IgnorePattern> patterns;
+
+  static std::shared_ptr<IgnoreLayer const> load(
+      std::shared_ptr<IgnoreLayer const> parent, std::string base, fs::path const &file) {
+    std::ifstream stream{file};
+    if (not stream) return parent;
+    auto layer = std::make_shared<IgnoreLayer>();
+    layer->parent = std::move(parent);
+    layer->base = std::move(base);
+    for (std::string line; std::getline(stream, line);) {
+      if (auto pattern = IgnorePattern::parse(line)) {
+        layer->patterns.push_back(std::move(*pattern));
+      }
+    }
+    return layer;
+  }
+
+  // Deeper layers take precedence, and the last matching pattern in a layer wins.
+  bool ignored(std::string_view path, bool is_directory) const {
+    auto relative = base.empty() ? path : path.substr(base.size() + 1);
+    auto name = path.substr(path.rfind('/') + 1);
+    for (auto it = patterns.rbegin(); it != patterns.rend(); ++it) {
+      if (it->directory_only and not is_directory) continue;
+      auto target = it->anchored ? relative : name;
+      if (wildmatch(it->glob.data(), it->glob.data() + it->glob.size(), target.data(),
+                    target.data() + target.size())) {
+        return not it->negated;
+      }
+    }
+    return parent and parent->ignored(path, is_directory);
+  }
+};
+
+// Locate the work tree containing dir and read the paths tracked in its index.
+struct GitRepository {
+  fs::path top, git_dir, common_dir;
+  std::vector<std::string> tracked;
+
+  static std::optional<GitRepository> find(fs::path dir) {
+    for (;; dir = dir.parent_path()) {
+      auto dot_git = dir / ".git";
+      if (fs::is_directory(dot_git)) return GitRepository{dir, dot_git};
+      if (fs::is_regular_file(dot_git)) {
+        // Work trees and submodules have a .git file instead: "gitdir: <path>"
+        std::string line;
+        std::getline(std::ifstream{dot_git}, line);
+        if (line.ends_with('\r')) line.pop_back();
+        if (not line.starts_with("gitdir: ")) return std::nullopt;
+        return GitRepository{dir, dir / line.substr(8)};
+      }
+      if (dir == dir.parent_path()) return std::nullopt;
+    }
+  }
+
+  GitRepository(fs::path top, fs::path git_dir)
+      : top{std::move(top)}, git_dir{std::move(git_dir)}, common_dir{this->git_dir} {
+    // Linked work trees keep their index in git_dir but share everything else.
+    std::ifstream commondir{this->git_dir / "commondir"};
+    if (std::string line; std::getline(commondir, line)) {
+      common_dir = this->git_dir / line;
+    }
+    read_index();
+  }
+
+  void read_index() {
+    if (not fs::exists(git_dir / "index")) return;
+    auto index = read(git_dir / "index");
+    auto data = reinterpret_cast<unsigned char const *>(index.c_str());
+    auto end = data + index.size();
+    auto be32 = [](unsigned char const *p) {
+      return uint32_t{p[0]} << 24 | uint32_t{p[1]} << 16 | uint32_t{p[2]} << 8 | p[3];
+    };
+    auto be16 = [](unsigned char const *p) { return uint16_t(p[0] << 8 | p[1]); };
+
+    if (index.size() < 12 or std::string_view{index}.substr(0, 4) != "DIRC") {
+      throw std::runtime_error{"could not parse " + (git_dir / "index").string()};
+    }
+    uint32_t version = be32(data + 4), count = be32(data + 8);
+    if (version < 2 or version > 4) {
+      throw std::runtime_error{"unsupported index version " + std::to_string(version)};
+    }
+
+    // Entries are: 40 bytes of stat data, the object id, then 16 bits of flags
+    size_t flags_offset = 40 + (sha256() ? 32 : 20);
+    tracked.reserve(count);
+    std::string path;
+    auto p = data + 12;
+    for (uint32_t i = 0; i < count; ++i) {
+      if (p + flags_offset + 2 > end) break;
+      uint16_t flags = be16(p + flags_offset);
+      auto name = p + flags_offset + 2;
+      if (version >= 3 and (flags & 0x4000)) name += 2;
+
+      if (version == 4) {
+        // The path is prefix compressed: strip some bytes from the previous path,
+        // then append a NUL terminated suffix.
+        size_t strip = *name & 127;
+        while (*name++ & 128) strip = ((strip + 1) << 7) | (*name & 127);
+        path.resize(path.size() - std::min(strip, path.size()));
+        auto suffix = reinterpret_cast<char const *>(name);
+        path += suffix;
+        p = name + std::strlen(suffix) + 1;
+      } else {
+        auto n = reinterpret_cast<char const *>(name);
+        path.assign(n, std::strlen(n));
+        // Entries are padded with 1-8 NULs to a multiple of 8 bytes
+        p += (name - p + path.size() + 8) & ~size_t{7};
+      }
+
+      // Sparse directory entries end with /
+      if (path.ends_with('/')) {
+        tracked.push_back(path.substr(0, path.size() - 1));
+      } else {
+        tracked.push_back(path);
+      }
+    }
+    std::sort(tracked.begin(), tracked.end());
+    tracked.erase(std::unique(tracked.begin(), tracked.end()), tracked.end());
+  }
+
+  bool sha256() const {
+    std::ifstream config{common_dir / "config"};
+    for (std::string line; std::getline(config, line);) {
+      std::erase_if(line, [](char c) { return c == ' ' or c == '\t'; });
+      std::transform(line.begin(), line.end(), line.begin(),
+                     [](unsigned char c) { return std::tolower(c); });
+      if (line == "objectformat=sha256") return true;
+    }
+    return false;
+  }
+
+  bool is_tracked(std::string const &path) const {
+    return std::binary_search(tracked.begin(), tracked.end(), path);
+  }
+};
+
+std::vector<std::string_view> split_list(std::string_view list) {
+  std::vector<std::string_view> items;
+  while (not list.empty()) {
+    auto semicolon = list.find(';');
+    items.push_back(list.substr(0, semicolon));
+    if (semicolon == std::string_view::npos) break;
+    list.remove_prefix(semicolon + 1);
+  }
+  return items;
+}
+
+// Evaluate the globs described in GLOBS, writing a CMake script to OUTPUT which
+// sets _MAUD_FILTERED_<name> to what glob(<name> ...) would produce. GLOBS holds
+// CMAKE_SOURCE_DIR, _MAUD_ALL, the rendered directory, and _MAUD_ALL_GENERATED
+// on the first four lines followed by a line for each glob: a ;-list of its name
+// then its arguments.
+//
+// Each distinct pattern is evaluated once for each path, in a single pass over
+// the file lists. The results are assembled in the same order as _maud_filter:
+// each path appears at the earliest inclusion pattern (or the initial set of all
+// paths, if the first pattern is an exclusion) which isn't followed by a
+// matching exclusion pattern.
+void filter_globs(fs::path const &globs_path, fs::path const &output_path) {
+  auto contents = read(globs_path);
+  std::vector<std::string_view> lines;
+  for (std::string_view rest = contents; not rest.empty();) {
+    auto newline = rest.find('\n');
+    lines.push_back(rest.substr(0, newline));
+    if (newline == std::string_view::npos) break;
+    rest.remove_prefix(newline + 1);
+  }
+  if (lines.size() < 4) {
+    throw std::runtime_error{"could not parse " + globs_path.string()};
+  }
+
+  struct Glob {
+    std::string_view name;
+    bool exclude_rendered = false;
+    // Pattern indices, and whether each is an exclusion
+    std::vector<std::pair<size_t, bool>> patterns;
+    std::string result;
+  };
+
+  std::vector<Regex> regexes;
+  std::vector<Glob> globs;
+  for (auto line : std::span{lines}.subspan(4)) {
+    if (line.empty()) continue;
+    auto args = split_list(line);
+    auto &glob = globs.emplace_back();
+    glob.name = args[0];
+    for (auto arg : std::span{args}.subspan(1)) {
+      if (arg.empty() or arg == "CONFIGURE_DEPENDS") continue;
+      if (arg == "EXCLUDE_RENDERED") {
+        glob.exclude_rendered = true;
+        continue;
+      }
+      bool exclusion = arg.starts_with('!');
+      if (exclusion) arg.remove_prefix(1);
+      auto it = std::find_if(regexes.begin(), regexes.end(),
+                             [&](Regex const &r) { return r.pattern() == arg; });
+      if (it == regexes.end()) it = regexes.emplace(regexes.end(), arg);
+      glob.patterns.emplace_back(it - regexes.begin(), exclusion);
+    }
+  }
+
+  auto filter_all = [&](std::string_view dir, std::string_view list, bool rendered) {
+    auto paths = split_list(list);
+
+    // For each glob, the matching paths in each segment; segment 0 is the initial
+    // set of all paths and segment k + 1 holds matches added by pattern k.
+    std::vector<std::vector<std::vector<std::string_view>>> segments(globs.size());
+    for (size_t g = 0; g < globs.size(); ++g) {
+      segments[g].resize(globs[g].patterns.size() + 1);
+    }
+
+    std::vector<char> matched(regexes.size());
+    for (auto path : paths) {
+      for (size_t r = 0; r < regexes.size(); ++r) matched[r] = regexes[r].search(path);
+
+      for (size_t g = 0; g < globs.size(); ++g) {
+        auto const &patterns = globs[g].patterns;
+        if (rendered and globs[g].exclude_rendered) continue;
+
+        bool initial = patterns.empty() or patterns[0].second;
+        std::optional<size_t> segment;
+        if (initial) segment = 0;
+        for (size_t k = 0; k < patterns.size(); ++k) {
+          auto [r, exclusion] = patterns[k];
+          if (not matched[r]) continue;
+          if (exclusion) {
+            segment.reset();
+          } else if (not segment) {
+            segment = k + 1;
+          }
+        }
+        if (segment) segments[g][*segment].push_back(path);
+      }
+    }
+
+    for (size_t g = 0; g < globs.size(); ++g) {
+      for (auto const &segment : segments[g]) {
+        for (auto path : segment) {
+          if (not globs[g].result.empty()) globs[g].result += ';';
+          globs[g].result += dir;
+          globs[g].result += '/';
+          globs[g].result += path;
+        }
+      }
+    }
+  };
+  filter_all(lines[0], lines[1], false);
+  filter_all(lines[2], lines[3], true);
+
+  auto output = write(output_path);
+  for (auto const &glob : globs) {
+    // Use a bracket argument whose delimiter can't appear in the result
+    std::string equals = "=";
+    while (glob.result.find("]" + equals + "]") != std::string::npos) equals += '=';
+    output << "set(_MAUD_FILTERED_" << glob.name << " [" << equals << "[" << glob.result
+           << "]" << equals << "])\n";
+  }
+}
+
+// Usage: maud_glob [--jobs=N] [--git] ROOT
+//        maud_glob --filter=GLOBS --output=OUTPUT
+//
+// Print a ;-list of the files and directories under ROOT, relative to ROOT,
+// which is identical to what would be produced by
+//
+//   file(GLOB_RECURSE matches LIST_DIRECTORIES true RELATIVE ROOT "ROOT/*")
+//   list(FILTER matches EXCLUDE REGEX "(/|^)[.]")
+//
+// except that hidden directories are pruned rather than walked then filtered.
+// Each level of the tree is listed concurrently.
+//
+// With --git, files and directories which are ignored by git are also pruned
+// (unless they are tracked in the index, as git ls-files would list them).
+// If ROOT is not in a git work tree, --git has no effect.
+//
+// With --filter, no directory is listed. Instead the globs described in GLOBS
+// are evaluated against the file lists it contains (see filter_globs).
+int main(int argc, char **argv) try {
+  unsigned jobs = default_jobs();
+  bool git = false;
+  std::string_view root_dir, globs, output;
+  for (std::string_view arg : std::span{argv + 1, argv + argc}) {
+    if (arg.starts_with("--jobs=")) {
+      jobs = std::stoul(std::string{arg.substr(7)});
+    } else if (arg == "--git") {
+      git = true;
+    } else if (arg.starts_with("--filter=")) {
+      globs = arg.substr(9);
+    } else if (arg.starts_with("--output=")) {
+      output = arg.substr(9);
+    } else if (root_dir.empty()) {
+      root_dir = arg;
+    } else {
+      root_dir = {};
+      break;
+    }
+  }
+
+  if (not globs.empty() and not output.empty()) {
+    filter_globs(globs, output);
+    return 0;
+  }
+
+  if (root_dir.empty()) {
+    std::cerr << "USAGE ERROR: maud_glob [--jobs=N] [--git] <ROOT> "
+                 "| --filter=<GLOBS> --output=<OUTPUT>"
+              << std::endl;
+    return 1;
+  }
+
+  // Paths are listed relative to top, which is the work tree if we're respecting
+  // git's ignore rules. Only paths under prefix are walked.
+  fs::path top = root_dir;
+  std::string prefix;
+  std::optional<GitRepository> repo;
+  std::shared_ptr<IgnoreLayer const> ancestors;
+  if (git) {
+    auto absolute = fs::absolute(top).lexically_normal();
+    if (not absolute.has_filename()) absolute = absolute.parent_path();
+    repo = GitRepository::find(absolute);
+    if (repo) {
+      top = repo->top;
+      prefix = absolute.lexically_relative(top).generic_string();
+      if (prefix == ".") prefix = "";
+    }
+  }
+  if (repo) {
+    ancestors = IgnoreLayer::load(nullptr, "", repo->common_dir / "info" / "exclude");
+    std::string dir;
+    for (auto const &component : fs::path{prefix}) {
+      ancestors = IgnoreLayer::load(ancestors, dir, top / dir / ".gitignore");
+      dir += (dir.empty() ? "" : "/") + component.generic_string();
+    }
+  }
+
+  auto is_hidden = [&](std::string_view path) {
+    path.remove_prefix(prefix.empty() ? 0 : prefix.size() + 1);
+    return path.starts_with('.') or path.find("/.") != std::string_view::npos;
+  };
+
+  struct Directory {
+    std::string path;
+    std::shared_ptr<IgnoreLayer const> layer;
+  };
+
+  struct Listing {
+    std::vector<Entry> entries;
+    std::shared_ptr<IgnoreLayer const> layer;
+  };
+
+  Root root{top};
+  std::vector<std::string> matches;
+  std::vector<Directory> level{{prefix, ancestors}};
+  while (not level.empty()) {
+    std::vector<Listing> listings(level.size());
+    parallel_for(level.size(), jobs, [&](size_t i) {
+      auto &[entries, layer] = listings[i];
+      root.list(level[i].path, entries);
+      if (not repo) return;
+
+      layer = IgnoreLayer::load(level[i].layer, level[i].path,
+                                top / level[i].path / ".gitignore");
+      if (not layer) return;
+
+      std::vector<Entry> kept;
+      for (auto &entry : entries) {
+        if (not layer->ignored(entry.path, entry.is_directory)
+            or repo->is_tracked(entry.path)) {
+          kept.push_back(std::move(entry));
+          continue;
+        }
+        if (not entry.is_directory) continue;
+
+        // An ignored directory may still contain tracked files, which we include
+        // (along with the directories leading to them) if they haven't been deleted.
+        auto dir = entry.path + "/";
+        for (auto it = std::lower_bound(repo->tracked.begin(), repo->tracked.end(), dir);
+             it != repo->tracked.end() and it->starts_with(dir); ++it) {
+          std::error_code ec;
+          if (is_hidden(*it) or not fs::exists(fs::symlink_status(top / *it, ec))) {
+            continue;
+          }
+          for (auto slash = it->find('/', prefix.size() + 1);
+               slash != std::string::npos; slash = it->find('/', slash + 1)) {
+            kept.push_back({it->substr(0, slash), false});
+          }
+          kept.push_back({*it, false});
+        }
+      }
+      entries = std::move(kept);
+    });
+
+    level.clear();
+    for (auto &[entries, layer] : listings) {
+      for (auto &[path, is_directory] : entries) {
+        if (is_directory) level.push_back({path, layer});
+        matches.push_back(std::move(path));
+      }
+    }
+  }
+
+  // file(GLOB) sorts lexicographically
+  std::sort(matches.begin(), matches.end());
+  matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+
+  std::string list;
+  for (auto const &match : matches) {
+    if (not list.empty()) list += ';';
+    list += std::string_view{match}.substr(prefix.empty() ? 0 : prefix.size() + 1);
+  }
+  std::cout << list;
+  return 0;
+} catch (std::exception const &e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+}
@@ -1,6 +1,183 @@
 module;
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 module executable;
 import maud_;
 
-int main() { compile_in2(std::cin, std::cout); }
+// Bump this whenever the output of compile_in2() changes,
+// so that stale compiled templates won't be reused.
+constexpr std::string_view COMPILED_VERSION = "maud_in2 2";
+
+// Usage: maud_in2 [--jobs=N] [--source-maps]
+//                 [--batch=BATCH [--variables=VARIABLES --rendered=DIR]]
+//
+// With no BATCH, a template is read from stdin and compiled to stdout.
+//
+// BATCH names a file containing a ;-list of alternating TEMPLATE and COMPILED
+// paths. Each TEMPLATE is compiled to its COMPILED path by N threads (by default,
+// one per hardware thread). The first line of each COMPILED file is a comment
+// holding a hash of its TEMPLATE; if that is already up to date, the TEMPLATE
+// is not recompiled and COMPILED is not touched.
+//
+// With --source-maps, compilation traces in COMPILED are reduced to a one line
+// comment per chunk of the template. COMPILED.map is also written, which maps
+// lines of COMPILED to the template lines and columns they were compiled from.
+//
+// If VARIABLES is specified, it holds the variables visible where templates are
+// rendered (except those defined for each template, which are known here): for
+// each variable its name, the length of its value, and its value, each followed
+// by a newline. Templates which render_in2() supports are then
+// rendered to DIR/<TEMPLATE's stem> (only writing if the contents have changed),
+// and a ;-list of the remaining TEMPLATEs (which must be rendered by cmake) is
+// printed to stdout.
+int main(int argc, char **argv) try {
+  unsigned jobs = default_jobs();
+  std::vector<std::string_view> templates_and_compiled;
+  Padded<> batch, variables_file;
+  bool batched = false, source_maps = false;
+  std::optional<std::string_view> rendered_dir;
+  std::unordered_map<std::string_view, std::string_view> variables;
+
+  for (std::string_view arg : std::span{argv + 1, argv + argc}) {
+    auto value = arg.substr(arg.find('=') + 1);
+    if (arg.starts_with("--jobs=")) {
+      jobs = std::stoul(std::string{value});
+    } else if (arg == "--source-maps") {
+      source_maps = true;
+    } else if (arg.starts_with("--batch=")) {
+      batch = read(value);
+      batched = true;
+      for (std::string_view list = batch; not list.empty();) {
+        auto item = list.substr(0, list.find(';'));
+        list.remove_prefix(std::min(item.size() + 1, list.size()));
+        if (not item.empty()) templates_and_compiled.push_back(item);
+      }
+    } else if (arg.starts_with("--variables=")) {
+      variables_file = read(value);
+      for (std::string_view dump = variables_file; not dump.empty();) {
+        auto name = dump.substr(0, dump.find('\n'));
+        dump.remove_prefix(name.size() + 1);
+        auto length = std::stoul(std::string{dump.substr(0, dump.find('\n'))});
+        dump.remove_prefix(dump.find('\n') + 1);
+        if (length > dump.size()) throw std::runtime_error{"truncated variables"};
+        variables[name] = dump.substr(0, length);
+        dump.remove_prefix(length);
+      }
+    } else if (arg.starts_with("--rendered=")) {
+      rendered_dir = value;
+    } else {
+      std::cerr << "USAGE ERROR: maud_in2 [--jobs=N] [--source-maps] [--batch=BATCH "
+                   "[--variables=VARIABLES --rendered=DIR]]\n";
+      return 1;
+    }
+  }
+
+  if (not batched) {
+    if (source_maps) {
+      std::cerr << "--source-maps requires --batch\n";
+      return 1;
+    }
+    compile_in2(std::cin, std::cout);
+    return 0;
+  }
+
+  if (templates_and_compiled.size() % 2 != 0) {
+    std::cerr << "Each template must be paired with a compiled path\n";
+    return 1;
+  }
+
+  std::vector<char> rendered(templates_and_compiled.size() / 2, false);
+  parallel_for(rendered.size(), jobs, [&](size_t i) {
+    std::filesystem::path template_path = templates_and_compiled[i * 2],
+                          compiled_path = templates_and_compiled[i * 2 + 1];
+    // Templates are mapped rather than read, and compiled output is flushed to
+    // the file in large chunks, so neither is ever copied whole.
+    Mapped in2{template_path};
+    auto header = "# "
+                + Hash{}
+                      .field(COMPILED_VERSION)
+                      .field(source_maps ? "source maps" : "inline traces")
+                      .field(in2)
+                      .hex()
+                + "\n";
+
+    if (not std::filesystem::exists(compiled_path)
+        or not std::string_view{Mapped{compiled_path}}.starts_with(header)) {
+      auto map_path = compiled_path;
+      map_path += ".map";
+      auto compiled = write(compiled_path);
+      compiled << header;
+      if (source_maps) {
+        auto map = write(map_path);
+        compile_in2(in2.c_str(), compiled, &map, /*first_line=*/2);
+      } else {
+        std::filesystem::remove(map_path);
+        compile_in2(in2.c_str(), compiled);
+      }
+    }
+
+    if (not rendered_dir) return;
+
+    // Variables which _maud_in2() and _maud_render() define for each template
+    auto render_path = std::filesystem::path{*rendered_dir} / template_path.stem();
+    std::string dir = template_path.parent_path().generic_string(),
+                render_file = render_path.generic_string(),
+                compiled_dir = compiled_path.parent_path().generic_string();
+    std::unordered_map<std::string_view, std::string_view> const locals{
+        {"dir", dir},
+        {"template", templates_and_compiled[i * 2]},
+        {"compiled", templates_and_compiled[i * 2 + 1]},
+        {"RENDER_FILE", render_file},
+        {"ARGC", "1"},
+        {"ARGV", templates_and_compiled[i * 2 + 1]},
+        {"ARGV0", templates_and_compiled[i * 2 + 1]},
+        {"ARGN", ""},
+        {"CMAKE_CURRENT_FUNCTION", "_maud_render"},
+        {"CMAKE_CURRENT_LIST_FILE", templates_and_compiled[i * 2 + 1]},
+        {"CMAKE_CURRENT_LIST_DIR", compiled_dir},
+    };
+    auto contents = render_in2(in2.c_str(), [&](std::string_view name) {
+      // These depend on this invocation's output or on where in the compiled
+      // template they're read, so only cmake can render them.
+      if (name == "unrendered" or name == "CMAKE_CURRENT_LIST_LINE"
+          or name == "CMAKE_CURRENT_FUNCTION_LIST_LINE") {
+        throw In2Unsupported{};
+      }
+      if (auto it = locals.find(name); it != locals.end()) {
+        return std::optional{it->second};
+      }
+      if (auto it = variables.find(name); it != variables.end()) {
+        return std::optional{it->second};
+      }
+      return std::optional<std::string_view>{};
+    });
+    if (not contents) return;
+
+    if (not std::filesystem::exists(render_path)
+        or std::string_view{read(render_path)} != *contents) {
+      write(render_path) << *contents;
+    }
+    rendered[i] = true;
+  });
+
+  if (rendered_dir) {
+    std::string_view separator = "";
+    for (size_t i = 0; i < rendered.size(); ++i) {
+      if (rendered[i]) continue;
+      std::cout << separator << templates_and_compiled[i * 2];
+      separator = ";";
+    }
+  }
+  return 0;
+} catch (std::exception const &e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+}
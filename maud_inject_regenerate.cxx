@@ -1,17 +1,31 @@
 module;
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #include <cerrno>
 #include <chrono>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
 #include <thread>
 module executable;
 
 namespace fs = std::filesystem;
 
-using std::operator""s;
 using std::operator""ms;
 
 constexpr std::string_view PATCH = R"cmake(
@@ -23,6 +37,122 @@ constexpr std::string_view PATCH = R"cmake(
 
 fs::path build;
 
+// Start a child which detaches from this session and locks lock_path. The parent
+// returns false once the child holds the lock (or has given up on it), so that
+// whoever launched us can block on the lock to wait for injection to finish.
+// The child returns true if it holds the lock and should go on to inject.
+#ifndef _WIN32
+bool detach_holding_lock(fs::path const &lock_path, char const * /*ready*/) {
+  int ready[2];
+  if (pipe(ready) != 0) throw std::system_error{errno, std::system_category(), "pipe"};
+
+  pid_t pid = fork();
+  if (pid < 0) throw std::system_error{errno, std::system_category(), "fork"};
+  if (pid > 0) {
+    close(ready[1]);
+    // The child closes its end of the pipe once it holds the lock or exits.
+    char c;
+    while (read(ready[0], &c, 1) < 0 and errno == EINTR);
+    return false;
+  }
+
+  close(ready[0]);
+  setsid();
+  int lock_fd = open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  struct flock lock {};
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  if (lock_fd < 0 or fcntl(lock_fd, F_SETLK, &lock) != 0) {
+    std::cout << "another maud_inject_regenerate is already running" << std::endl;
+    return false;
+  }
+  close(ready[1]);
+  return true;
+}
+#else
+// Windows can't fork, so the child is this program relaunched with an extra
+// argument --ready=HANDLE: the inherited write end of a pipe which the parent
+// reads until the child closes it.
+bool detach_holding_lock(fs::path const &lock_path, char const *ready) {
+  auto fail = [](char const *what) {
+    throw std::system_error{static_cast<int>(GetLastError()), std::system_category(),
+                            what};
+  };
+
+  if (ready == nullptr) {
+    SECURITY_ATTRIBUTES inheritable{sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE};
+    HANDLE ready_read, ready_write;
+    if (not CreatePipe(&ready_read, &ready_write, &inheritable, 0)) fail("pipe");
+    SetHandleInformation(ready_read, HANDLE_FLAG_INHERIT, 0);
+
+    std::wstring exe(MAX_PATH, L'\0');
+    while (true) {
+      DWORD size =
+          GetModuleFileNameW(nullptr, exe.data(), static_cast<DWORD>(exe.size()));
+      if (size == 0) fail("GetModuleFileName");
+      if (size < exe.size()) {
+        exe.resize(size);
+        break;
+      }
+      exe.resize(exe.size() * 2);
+    }
+    auto quote = [](std::wstring arg) {
+      // A trailing backslash would escape the closing quote.
+      if (arg.ends_with(L'\\')) arg += L'\\';
+      return L'"' + arg + L'"';
+    };
+    std::wstring command_line =
+        quote(exe) + L" " + quote(build.wstring()) + L" --ready="
+        + std::to_wstring(reinterpret_cast<uintptr_t>(ready_write));
+
+    // Like a forked child, the child inherits our output (which cmake redirects
+    // to maud_inject_regenerate.log).
+    STARTUPINFOW startup{};
+    startup.cb = sizeof(startup);
+    startup.dwFlags = STARTF_USESTDHANDLES;
+    startup.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+    startup.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+    startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+    PROCESS_INFORMATION child;
+    if (not CreateProcessW(exe.c_str(), command_line.data(), nullptr, nullptr,
+                           /*bInheritHandles=*/TRUE,
+                           DETACHED_PROCESS | CREATE_NEW_PROCESS_GROUP, nullptr,
+                           nullptr, &startup, &child)) {
+      fail("CreateProcess");
+    }
+    CloseHandle(child.hThread);
+    CloseHandle(child.hProcess);
+    CloseHandle(ready_write);
+
+    // The child closes its end of the pipe once it holds the lock or exits.
+    char c;
+    DWORD bytes;
+    while (ReadFile(ready_read, &c, 1, &bytes, nullptr) and bytes != 0);
+    CloseHandle(ready_read);
+    return false;
+  }
+
+  // This is the child. (The lock is never unlocked; it is released when we exit.)
+  HANDLE ready_write =
+      reinterpret_cast<HANDLE>(static_cast<uintptr_t>(std::stoull(ready)));
+  HANDLE lock_file = CreateFileW(lock_path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                                 FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                 OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  OVERLAPPED overlapped{};
+  if (lock_file == INVALID_HANDLE_VALUE
+      or not LockFileEx(lock_file, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY,
+                        0, MAXDWORD, MAXDWORD, &overlapped)) {
+    std::cout << "another maud_inject_regenerate is already running" << std::endl;
+    return false;
+  }
+  CloseHandle(ready_write);
+  return true;
+}
+#endif
+
+#ifdef _WIN32
+// CMake (or a build tool) may still hold the files open, and on Windows that
+// makes them impossible to replace, so failed steps are retried with backoff.
 template <typename F>
 void exponential_backoff(F f) {
   auto delay = 50ms;
@@ -32,9 +162,8 @@ void exponential_backoff(F f) {
     } catch (std::exception const &e) {
       std::cout << " failed: '" << e.what() << "'\n";
     }
-    if (delay > 1s) break;
+    if (delay > 1000ms) break;
 
-    // retry with exponential back off
     std::cout << " retrying in " << (delay / 1ms) << "ms" << std::endl;
     std::this_thread::sleep_for(delay);
     delay *= 2;
@@ -42,9 +171,76 @@ void exponential_backoff(F f) {
   std::cout << " gave up with retrying" << std::endl;
   throw std::runtime_error("timed out while retrying");
 }
+#else
+template <typename F>
+void exponential_backoff(F f) {
+  f();
+}
+#endif
 
+// Block until both paths exist.
+void wait_for(fs::path const &a, fs::path const &b) {
+  if (fs::exists(a) and fs::exists(b)) return;
+  std::cout << "didn't exist yet, waiting" << std::endl;
+#ifdef __linux__
+  // Watch before checking again, so that no creation can be missed.
+  int inotify = inotify_init1(IN_CLOEXEC);
+  if (inotify < 0) throw std::system_error{errno, std::system_category(), "inotify"};
+  for (auto const &dir : {a.parent_path(), b.parent_path()}) {
+    if (inotify_add_watch(inotify, dir.c_str(), IN_CREATE | IN_MOVED_TO) < 0) {
+      throw std::system_error{errno, std::system_category(), "watching " + dir.string()};
+    }
+  }
+  alignas(inotify_event) char buffer[1 << 12];
+  while (not fs::exists(a) or not fs::exists(b)) {
+    if (read(inotify, buffer, sizeof(buffer)) < 0 and errno != EINTR) {
+      throw std::system_error{errno, std::system_category(), "reading inotify events"};
+    }
+  }
+  close(inotify);
+#elif defined(_WIN32)
+  // Watch before checking again, so that no creation can be missed.
+  HANDLE changes[2];
+  DWORD count = 0;
+  for (auto const &dir : {a.parent_path(), b.parent_path()}) {
+    changes[count] = FindFirstChangeNotificationW(dir.c_str(), FALSE,
+                                                  FILE_NOTIFY_CHANGE_FILE_NAME);
+    if (changes[count] == INVALID_HANDLE_VALUE) {
+      throw std::system_error{static_cast<int>(GetLastError()), std::system_category(),
+                              "watching " + dir.string()};
+    }
+    ++count;
+  }
+  while (not fs::exists(a) or not fs::exists(b)) {
+    DWORD i = WaitForMultipleObjects(count, changes, FALSE, INFINITE) - WAIT_OBJECT_0;
+    if (i >= count or not FindNextChangeNotification(changes[i])) {
+      throw std::system_error{static_cast<int>(GetLastError()), std::system_category(),
+                              "waiting for changes"};
+    }
+  }
+  for (DWORD i = 0; i < count; ++i) FindCloseChangeNotification(changes[i]);
+#else
+  while (not fs::exists(a) or not fs::exists(b)) std::this_thread::sleep_for(50ms);
+#endif
+}
+
+// Usage: maud_inject_regenerate BUILD
+//
+// Wait for CMake to write BUILD/CMakeFiles/VerifyGlobs.cmake, then patch it so that
+// checking whether to regenerate also runs _maud_maybe_regenerate().
+//
+// maud_inject_regenerate exits once a detached child holds a lock on
+// BUILD/_maud/inject.lock. The child holds that lock until the patch is in place
+// (or BUILD/_maud/maud_inject_regenerate.error has been written), so after CMake
+// exits file(LOCK) can be used to wait for injection to finish.
 int main(int argc, char **argv) try {
-  if (argc != 2) {
+#ifdef _WIN32
+  bool usage_ok =
+      argc == 2 or (argc == 3 and std::string_view{argv[2]}.starts_with("--ready="));
+#else
+  bool usage_ok = argc == 2;
+#endif
+  if (not usage_ok) {
     std::cerr << "USAGE ERROR: maud_inject_regenerate <BUILD>" << std::endl;
     return EINVAL;
   }
@@ -66,16 +262,15 @@ int main(int argc, char **argv) try {
   //
   // That being the case, the only way to patch VerifyGlobs.cmake is to launch
   // a background process which patches as soon as the file exists. (We need to
-  // use `setsid` or `start /b` for this because without it execute_process()
-  // waits for all child processes to complete.)
+  // detach, because otherwise execute_process() waits for all child processes to
+  // complete.)
+  char const *ready = argc == 3 ? argv[2] + std::string_view{"--ready="}.size() : nullptr;
+  if (not detach_holding_lock(build / "_maud" / "inject.lock", ready)) return 0;
 
-  std::this_thread::sleep_for(50ms);
-  while (not fs::exists(script) or not fs::exists(flag)) {
-    std::cout << "didn't exist yet, retrying in 50ms" << std::endl;
-    std::this_thread::sleep_for(50ms);
-  }
+  wait_for(script, flag);
 
-  // At this point, CMake has just finished (or will do so shortly).
+  // At this point, CMake has just finished (or will do so shortly). CMake writes
+  // the script before touching the flag, so the script is complete.
   //
   // Frequently Ninja (or other build tool) will be running immediately after CMake,
   // and *its* first action is always to run the verification script to determine if
@@ -88,25 +283,23 @@ int main(int argc, char **argv) try {
   // regeneration right now, since this can lead to a chain of repeated spurious
   // regeneration.
 
-  std::cout << "reading current script" << std::endl;
-  std::string contents;
+  std::cout << "creating patched script" << std::endl;
   exponential_backoff([&] {
     std::ifstream stream{script};
-    contents.resize(stream.seekg(0, std::ios_base::end).tellg());
-    stream.seekg(0).read(contents.data(), contents.size());
-  });
+    std::string contents{std::istreambuf_iterator<char>{stream}, {}};
+    if (not stream) throw std::runtime_error{"could not read " + script.string()};
 
-  std::cout << "creating patched script" << std::endl;
-  exponential_backoff(
-      [&] { std::ofstream{patched, std::ios_base::app} << contents << PATCH; });
+    std::ofstream out{patched};
+    out << contents << PATCH;
+    if (not out) throw std::runtime_error{"could not write " + patched.string()};
+  });
 
-  std::cout << "getting flag's mtime" << std::endl;
+  // Patching the script will make it newer than build.ninja, which will trigger
+  // spurious regeneration. We can overwrite its mtime to prevent that. The flag is
+  // never touched except to trigger regeneration, so we can reuse its mtime as "not
+  // newer than debug.ninja".
   fs::file_time_type mtime;
   exponential_backoff([&] {
-    // Patching the script will make it newer than build.ninja, which will trigger
-    // spurious regeneration. We can overwrite its mtime to prevent that. The flag is
-    // never touched except to trigger regeneration, so we can reuse its mtime as "not
-    // newer than debug.ninja".
     mtime = fs::last_write_time(flag);
     fs::last_write_time(patched, mtime);
   });
@@ -114,10 +307,10 @@ int main(int argc, char **argv) try {
   std::cout << "swapping in patched script" << std::endl;
   exponential_backoff([&] {
     // Modifying the script in place leaves a wider window for detecting the change;
-    // writing a separate patched script then renaming it is closer to an atomic operation
-    // (it is actually atomic on some platforms).
+    // writing a separate patched script then renaming it is closer to an atomic
+    // operation (it is actually atomic on some platforms).
     fs::rename(patched, script);
-    // Set mtime once more, just in case rename chaned it.
+    // Set mtime once more, just in case rename changed it.
     fs::last_write_time(script, mtime);
   });
 } catch (std::exception const &e) {
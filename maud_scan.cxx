@@ -2,12 +2,22 @@
 //
 module;
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <charconv>
 #include <cstdlib>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <span>
+#include <sstream>
 #include <string>
 #include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 module executable;
@@ -24,32 +34,14 @@ import maud_;
 // - anything other than a PP directive in the global module fragment
 // - malformed attributes
 
-// FIXME skip attributes
-
-// FIXME handle header units
-
 // TODO replace <iostream> with <format>
 
 // TODO replace char const* with Location and track lines for better error reporting
 template <char... CHARS>
-constexpr auto first_of = [](auto s) {
-  while (*s != 0) {
-    bool any_matched = (... or (*s == CHARS));
-    if (any_matched) break;
-    ++s;
-  }
-  return s;
-};
+constexpr auto first_of = [](auto s) { return find_first(OF<CHARS...>, s); };
 
 template <char... CHARS>
-constexpr auto first_not_of = [](auto s) {
-  while (*s != 0) {
-    bool any_matched = (... or (*s == CHARS));
-    if (not any_matched) break;
-    ++s;
-  }
-  return s;
-};
+constexpr auto first_not_of = [](auto s) { return find_first(not OF<CHARS...>, s); };
 
 void chomp_until(auto delimiter, auto &s) {
   // NOTE: if the delimiter doesn't find anything, we'll chomp out the whole string
@@ -143,6 +135,38 @@ void chomp_past_whitespace(auto &s) {
   chomp_until(first_not_of<' ', '\n', '\r', '\t'>, s);
 }
 
+// Skip any attributes (whose arguments might contain ':' or ';')
+// and the whitespace around them.
+void chomp_past_attributes(auto &s) {
+  while (true) {
+    chomp_past_whitespace(s);
+    if (s[0] != '[' or s[1] != '[') return;
+
+    s += 2;
+    for (int depth = 2; depth != 0;) {
+      chomp_until(first_of<'[', ']', '"', '\''>, s);
+      switch (*s) {
+        case 0: return;
+        case '[': ++depth, ++s; break;
+        case ']': --depth, ++s; break;
+        case '"': chomp_until_end_of_string_literal(s); break;
+        case '\'':
+          ++s;
+          while (*s != 0 and *s != '\'') s += s[0] == '\\' and s[1] != 0 ? 2 : 1;
+          if (*s != 0) ++s;
+          break;
+      }
+    }
+  }
+}
+
+// Skip the remainder of a module or import declaration, including the ';'
+void chomp_past_end_of_declaration(auto &s) {
+  chomp_past_attributes(s);
+  chomp_until(first_of<';'>, s);
+  if (*s != 0) ++s;
+}
+
 std::string chomp_name(auto &s) {
   auto name_begin = s;
   chomp_until(
@@ -164,23 +188,497 @@ std::string chomp_name(auto &s) {
   return {name_begin, s};
 }
 
-void scan_file(std::string_view path, auto s) {
-  bool saw_export = false;
+// Object-like macros whose definitions are known to the scanner, each mapped to its
+// replacement list (or nullopt if it is known to be undefined). A name which is absent
+// might have been defined anywhere (on the command line, by an #include, ...)
+using Macros = std::unordered_map<std::string, std::optional<std::string>>;
+
+// Tracks which conditional groups of a preamble are skipped by the preprocessor,
+// which is possible as long as their conditions only depend on known macros.
+// Groups whose conditions could not be evaluated are UNKNOWN.
+class Conditionals {
+ public:
+  enum State { ACTIVE, INACTIVE, UNKNOWN };
+
+  explicit Conditionals(Macros const *defines = nullptr) : _defines{defines} {}
+
+  State state() const {
+    State state = ACTIVE;
+    for (auto const &group : _groups) {
+      if (group.state == INACTIVE) return INACTIVE;
+      if (group.state == UNKNOWN) state = UNKNOWN;
+    }
+    return state;
+  }
+
+  // Whether any condition was evaluated, in which case the state depended on defines.
+  bool evaluated() const { return _evaluated; }
+
+  // The macros defined by the directives so far.
+  Macros definitions() && { return std::move(_local); }
+
+  // Process the directive at s, then advance s past it.
+  void directive(auto &s) {
+    auto begin = s + 1;
+    chomp_past_unescaped_line_ending(s);
+    std::string_view line{begin, s};
+
+    auto word = [&] {
+      line.remove_prefix(std::min(line.find_first_not_of(" \t"), line.size()));
+      size_t size = 0;
+      while (size < line.size() and is_identifier(line[size])) ++size;
+      auto word = line.substr(0, size);
+      line.remove_prefix(size);
+      return word;
+    };
+
+    auto name = word();
+    if (name == "if") return push([&] { return evaluate(line); });
+    if (name == "ifdef") return push([&] { return is_defined(word()); });
+    if (name == "ifndef") return push([&] { return negate(is_defined(word())); });
+    if (name == "elif") return elif([&] { return evaluate(line); });
+    if (name == "elifdef") return elif([&] { return is_defined(word()); });
+    if (name == "elifndef") return elif([&] { return negate(is_defined(word())); });
+
+    if (name == "else") {
+      if (_groups.empty()) return;
+      auto &group = _groups.back();
+      group.state = group.taken == ACTIVE     ? INACTIVE
+                  : group.taken == INACTIVE ? ACTIVE
+                                            : UNKNOWN;
+      group.taken = ACTIVE;
+      return;
+    }
+
+    if (name == "endif") {
+      if (not _groups.empty()) _groups.pop_back();
+      return;
+    }
+
+    if (name == "define" or name == "undef") {
+      auto state = this->state();
+      if (state == INACTIVE) return;
+
+      std::string macro{word()};
+      if (state == UNKNOWN or (name == "define" and line.starts_with('('))) {
+        // We can't know whether (or to what) this macro is defined.
+        _unknown.insert(std::move(macro));
+        return;
+      }
+
+      _unknown.erase(macro);
+      if (name == "undef") {
+        _local[std::move(macro)] = std::nullopt;
+      } else {
+        _local[std::move(macro)] = std::string{line};
+      }
+    }
+  }
+
+ private:
+  using Value = std::optional<long long>;
+
+  struct Group {
+    State state;
+    // ACTIVE if a branch of this group has been taken, INACTIVE if none
+    // has, or UNKNOWN if one might have been.
+    State taken;
+  };
+
+  struct Token {
+    enum { NUMBER, UNKNOWN, PUNCTUATOR } kind;
+    long long value = 0;
+    std::string_view punctuator = "";
+  };
+
+  static bool is_identifier(char c) {
+    return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9')
+        or c == '_';
+  }
+
+  static State truth(Value value) {
+    if (not value) return UNKNOWN;
+    return *value ? ACTIVE : INACTIVE;
+  }
+
+  static State negate(State state) {
+    if (state == UNKNOWN) return UNKNOWN;
+    return state == ACTIVE ? INACTIVE : ACTIVE;
+  }
+
+  void push(auto condition) {
+    if (state() == INACTIVE) {
+      _groups.push_back({INACTIVE, ACTIVE});
+      return;
+    }
+    auto state = condition();
+    _groups.push_back({state, state});
+  }
+
+  void elif(auto condition) {
+    if (_groups.empty()) return;
+    auto &group = _groups.back();
+    if (group.taken == ACTIVE) {
+      group.state = INACTIVE;
+      return;
+    }
+
+    auto state = condition();
+    if (group.taken == INACTIVE) {
+      group.state = group.taken = state;
+      return;
+    }
+
+    // A previous branch might have been taken
+    group.state = state == INACTIVE ? INACTIVE : UNKNOWN;
+    if (state == ACTIVE) group.taken = ACTIVE;
+  }
+
+  // nullptr if it is unknown whether name is defined
+  std::optional<std::string> const *lookup(std::string const &name) const {
+    if (_unknown.contains(name)) return nullptr;
+    if (auto it = _local.find(name); it != _local.end()) return &it->second;
+    if (_defines) {
+      if (auto it = _defines->find(name); it != _defines->end()) return &it->second;
+    }
+    return nullptr;
+  }
+
+  State is_defined(std::string_view name) {
+    _evaluated = true;
+    auto macro = lookup(std::string{name});
+    if (not macro) return UNKNOWN;
+    return macro->has_value() ? ACTIVE : INACTIVE;
+  }
+
+  State evaluate(std::string_view condition) {
+    _evaluated = true;
+    std::vector<Token> tokens;
+    if (not tokenize(condition, 0, tokens)) return UNKNOWN;
+    Parser parser{tokens};
+    auto value = parser.conditional();
+    if (parser.i != tokens.size() or parser.error) return UNKNOWN;
+    return truth(value);
+  }
+
+  // Tokenize a condition, replacing known macros with their (tokenized) replacement
+  // lists and defined-macro-expressions with their values. Returns false if the
+  // condition could not be tokenized, for example because it contains a literal.
+  bool tokenize(std::string_view text, int depth, std::vector<Token> &tokens) const {
+    if (depth > 16) return false;
+
+    size_t i = 0;
+    auto skip_whitespace = [&] {
+      while (i < text.size()) {
+        if (std::string_view{" \t\r\n\\"}.find(text[i]) != std::string_view::npos) {
+          ++i;
+        } else if (text.substr(i).starts_with("/*")) {
+          i = std::min(text.find("*/", i + 2), text.size() - 2) + 2;
+        } else if (text.substr(i).starts_with("//")) {
+          i = text.size();
+        } else {
+          break;
+        }
+      }
+    };
+    auto identifier = [&] {
+      auto begin = i;
+      while (i < text.size() and is_identifier(text[i])) ++i;
+      return text.substr(begin, i - begin);
+    };
+
+    while (true) {
+      skip_whitespace();
+      if (i == text.size()) return true;
+
+      if (text[i] >= '0' and text[i] <= '9') {
+        std::string digits;
+        for (char c : identifier()) {
+          if (c != '\'') digits += c;
+        }
+        while (i < text.size() and text[i] == '\'') {
+          ++i;
+          digits += identifier();
+        }
+        while (not digits.empty()
+               and std::string_view{"uUlLzZ"}.find(digits.back()) != std::string::npos) {
+          digits.pop_back();
+        }
+        int base = 10;
+        std::string_view number = digits;
+        if (number.starts_with("0x") or number.starts_with("0X")) {
+          base = 16;
+          number.remove_prefix(2);
+        } else if (number.starts_with("0b") or number.starts_with("0B")) {
+          base = 2;
+          number.remove_prefix(2);
+        } else if (number.size() > 1 and number[0] == '0') {
+          base = 8;
+        }
+        unsigned long long value;
+        auto [end, ec] = std::from_chars(number.begin(), number.end(), value, base);
+        if (ec != std::errc{} or end != number.end()) return false;
+        tokens.push_back({Token::NUMBER, static_cast<long long>(value)});
+        continue;
+      }
+
+      if (auto name = identifier(); not name.empty()) {
+        if (name == "true" or name == "false") {
+          tokens.push_back({Token::NUMBER, name == "true"});
+          continue;
+        }
+
+        constexpr std::pair<std::string_view, std::string_view> ALTERNATIVES[] = {
+            {"and", "&&"},   {"or", "||"},    {"not", "!"},  {"not_eq", "!="},
+            {"bitand", "&"}, {"bitor", "|"},  {"xor", "^"},  {"compl", "~"},
+        };
+        if (auto alt = std::find_if(std::begin(ALTERNATIVES), std::end(ALTERNATIVES),
+                                    [&](auto alt) { return alt.first == name; });
+            alt != std::end(ALTERNATIVES)) {
+          tokens.push_back({Token::PUNCTUATOR, 0, alt->second});
+          continue;
+        }
+
+        if (name == "defined") {
+          skip_whitespace();
+          bool parenthesized = i < text.size() and text[i] == '(';
+          if (parenthesized) {
+            ++i;
+            skip_whitespace();
+          }
+          auto macro = lookup(std::string{identifier()});
+          if (parenthesized) {
+            skip_whitespace();
+            if (i == text.size() or text[i] != ')') return false;
+            ++i;
+          }
+          if (macro) {
+            tokens.push_back({Token::NUMBER, macro->has_value()});
+          } else {
+            tokens.push_back({Token::UNKNOWN});
+          }
+          continue;
+        }
+
+        auto macro = lookup(std::string{name});
+        if (not macro) {
+          tokens.push_back({Token::UNKNOWN});
+        } else if (not macro->has_value()) {
+          // Identifiers which aren't macros are replaced with 0
+          tokens.push_back({Token::NUMBER, 0});
+        } else if (not tokenize(**macro, depth + 1, tokens)) {
+          return false;
+        }
+        continue;
+      }
+
+      std::string_view punctuator;
+      for (std::string_view p : {"||", "&&", "==", "!=", "<=", ">=", "<<", ">>"}) {
+        if (text.substr(i).starts_with(p)) punctuator = p;
+      }
+      if (punctuator.empty()) {
+        auto p = std::string_view{"()!~-+*/%<>&|^?:"}.find(text[i]);
+        if (p == std::string_view::npos) return false;
+        punctuator = std::string_view{"()!~-+*/%<>&|^?:"}.substr(p, 1);
+      }
+      i += punctuator.size();
+      tokens.push_back({Token::PUNCTUATOR, 0, punctuator});
+    }
+  }
+
+  // Evaluates tokens as a constant expression. Values which depend on an unknown
+  // are unknown, except where they are short circuited.
+  struct Parser {
+    std::vector<Token> const &tokens;
+    size_t i = 0;
+    bool error = false;
+
+    bool accept(std::string_view punctuator) {
+      if (i == tokens.size() or tokens[i].kind != Token::PUNCTUATOR
+          or tokens[i].punctuator != punctuator) {
+        return false;
+      }
+      ++i;
+      return true;
+    }
+
+    Value conditional() {
+      auto condition = logical_or();
+      if (not accept("?")) return condition;
+      auto then = conditional();
+      if (not accept(":")) error = true;
+      auto otherwise = conditional();
+      if (condition) return *condition ? then : otherwise;
+      return then == otherwise ? then : std::nullopt;
+    }
+
+    Value logical_or() {
+      auto l = logical_and();
+      while (accept("||")) {
+        auto r = logical_and();
+        if ((l and *l) or (r and *r)) {
+          l = 1;
+        } else if (l and r) {
+          l = 0;
+        } else {
+          l = std::nullopt;
+        }
+      }
+      return l;
+    }
 
+    Value logical_and() {
+      auto l = binary(0);
+      while (accept("&&")) {
+        auto r = binary(0);
+        if ((l and not *l) or (r and not *r)) {
+          l = 0;
+        } else if (l and r) {
+          l = 1;
+        } else {
+          l = std::nullopt;
+        }
+      }
+      return l;
+    }
+
+    static constexpr std::string_view BINARY[][4] = {
+        {"|"}, {"^"}, {"&"}, {"==", "!="}, {"<", ">", "<=", ">="},
+        {"<<", ">>"}, {"+", "-"}, {"*", "/", "%"},
+    };
+
+    Value binary(size_t level) {
+      if (level == std::size(BINARY)) return unary();
+      auto l = binary(level + 1);
+      while (true) {
+        auto op = std::find_if(std::begin(BINARY[level]), std::end(BINARY[level]),
+                               [&](auto op) { return not op.empty() and accept(op); });
+        if (op == std::end(BINARY[level])) return l;
+        auto r = binary(level + 1);
+        l = l and r ? apply(*op, *l, *r) : std::nullopt;
+      }
+    }
+
+    static Value apply(std::string_view op, long long l, long long r) {
+      // Wrap rather than overflow
+      auto u = [](long long v) { return static_cast<unsigned long long>(v); };
+      if (op == "|") return l | r;
+      if (op == "^") return l ^ r;
+      if (op == "&") return l & r;
+      if (op == "==") return l == r;
+      if (op == "!=") return l != r;
+      if (op == "<") return l < r;
+      if (op == ">") return l > r;
+      if (op == "<=") return l <= r;
+      if (op == ">=") return l >= r;
+      if (op == "+") return static_cast<long long>(u(l) + u(r));
+      if (op == "-") return static_cast<long long>(u(l) - u(r));
+      if (op == "*") return static_cast<long long>(u(l) * u(r));
+      if (r == 0) return std::nullopt;
+      if (op == "/") return l / r;
+      if (op == "%") return l % r;
+      if (r < 0 or r > 63) return std::nullopt;
+      if (op == "<<") return static_cast<long long>(u(l) << r);
+      return l >> r;
+    }
+
+    Value unary() {
+      if (accept("!")) {
+        auto v = unary();
+        return v ? Value{not *v} : std::nullopt;
+      }
+      if (accept("~")) {
+        auto v = unary();
+        return v ? Value{~*v} : std::nullopt;
+      }
+      if (accept("-")) {
+        auto v = unary();
+        if (not v) return std::nullopt;
+        return static_cast<long long>(0ull - static_cast<unsigned long long>(*v));
+      }
+      if (accept("+")) return unary();
+      if (accept("(")) {
+        auto v = conditional();
+        if (not accept(")")) error = true;
+        return v;
+      }
+      if (i == tokens.size() or tokens[i].kind == Token::PUNCTUATOR) {
+        error = true;
+        return std::nullopt;
+      }
+      auto const &token = tokens[i++];
+      if (token.kind == Token::UNKNOWN) return std::nullopt;
+      return token.value;
+    }
+  };
+
+  Macros const *_defines;
+  Macros _local;
+  std::unordered_set<std::string> _unknown;
+  std::vector<Group> _groups;
+  bool _evaluated = false;
+};
+
+// Read the object-like macros defined by a header like options.h
+Macros read_defines(char const *s) {
+  Conditionals conditionals;
+  while (*s != 0) {
+    chomp_past_whitespace(s);
+    if (*s == '#') {
+      conditionals.directive(s);
+    } else {
+      chomp_past_unescaped_line_ending(s);
+    }
+  }
+  return std::move(conditionals).definitions();
+}
+
+struct Scanned {
   bool is_interface = false;
   bool is_partition = false;
   std::string logical_name, maud_module_name;
   std::vector<std::string> requires_logical_names;
+  // Imported header units, as spelled: <angled> or "quoted"
+  std::vector<std::string> header_units;
+  size_t preamble_size = 0;
+  // The preamble contains declarations in a conditional group which couldn't be
+  // evaluated; it must be scanned by a preprocessing scanner instead.
+  bool requires_preprocessing = false;
+  // Preprocessing conditions were evaluated, so the scan depends on the defines.
+  bool evaluated_conditions = false;
+};
+
+Scanned scan(auto s, Macros const *defines = nullptr) {
+  auto begin = s;
+  bool saw_export = false;
+  Scanned scanned;
+  auto &[is_interface, is_partition, logical_name, maud_module_name,
+         requires_logical_names, header_units, preamble_size, requires_preprocessing,
+         evaluated_conditions] = scanned;
+  Conditionals conditionals{defines};
 
   while (*s != 0) {
     chomp_past_whitespace(s);
+
+    if (s[0] != '#' and s[0] != 0 and not(s[0] == '/' and (s[1] == '/' or s[1] == '*'))) {
+      if (auto state = conditionals.state(); state == Conditionals::INACTIVE) {
+        // Skipped groups needn't even be valid C++
+        chomp_until(first_of<'\n'>, s);
+        continue;
+      } else if (state == Conditionals::UNKNOWN) {
+        // This might be a declaration, or it might be preprocessed away.
+        // Keep scanning anyway so that preamble_size covers the whole preamble.
+        requires_preprocessing = true;
+      }
+    }
+
     switch (s[0]) {
       case ';':
         ++s;
         continue;
 
       case '#':
-        chomp_past_unescaped_line_ending(s);
+        conditionals.directive(s);
         continue;
 
       case '/':
@@ -193,9 +691,14 @@ void scan_file(std::string_view path, auto s) {
           s += 2;
           while (true) {
             chomp_until(first_of<'*'>, s);
+            if (*s == 0) [[unlikely]] {
+              // Unterminated comment; badly formed C++ source
+              goto done;
+            }
             if (s[1] == '/') break;
             ++s;
           }
+          s += 2;
           continue;
         }
 
@@ -215,10 +718,10 @@ void scan_file(std::string_view path, auto s) {
           auto name = chomp_name(s);
 
           // is it a partition?
-          chomp_until(first_of<';', ':'>, s);
-          if (*s == ';') {
+          chomp_past_whitespace(s);
+          if (*s != ':') {
             // not a partition
-            ++s;
+            chomp_past_end_of_declaration(s);
 
             maud_module_name = name;
             if (saw_export) {
@@ -243,8 +746,7 @@ void scan_file(std::string_view path, auto s) {
             is_interface = true;
           }
 
-          chomp_until(first_of<';'>, s);
-          ++s;
+          chomp_past_end_of_declaration(s);
           continue;
         }
 
@@ -258,11 +760,21 @@ void scan_file(std::string_view path, auto s) {
             ++s;
             chomp_past_whitespace(s);
             requires_logical_names.push_back(maud_module_name + ":" + chomp_name(s));
+          } else if (*s == '<' or *s == '"') {
+            // header unit
+            auto name_begin = s++;
+            if (*name_begin == '<') {
+              chomp_until(first_of<'>', '\n'>, s);
+            } else {
+              chomp_until(first_of<'"', '\n'>, s);
+            }
+            if (*s == '>' or *s == '"') {
+              header_units.emplace_back(name_begin, ++s);
+            }
           } else {
             requires_logical_names.push_back(chomp_name(s));
           }
-          chomp_until(first_of<';'>, s);
-          ++s;
+          chomp_past_end_of_declaration(s);
           continue;
         }
 
@@ -284,50 +796,129 @@ void scan_file(std::string_view path, auto s) {
   }
 
 done:
-  std::cout << "{\n";
-  std::cout << "  \"revision\": 0,\n";
-  std::cout << "  \"rules\": [\n";
-  std::cout << "    {\n";
-  std::cout << "      \"primary-output\": \"" << path << ".o\"\n";
+  preamble_size = s - begin;
+  evaluated_conditions = conditionals.evaluated();
+  return scanned;
+}
 
-  if (is_partition or is_interface) {
-    std::cout << "      \"provides\": [\n";
-    std::cout << "        {\n";
-    std::cout << "          \"is-interface\": " << (is_interface ? "true" : "false");
-    std::cout << ",\n";
-    std::cout << "          \"logical-name\": \"" << logical_name << "\"";
-    std::cout << ",\n";
-    std::cout << "          \"source-path\": \"" << path << "\"";
-    std::cout << "\n";
-    std::cout << "        }\n";
-    std::cout << "      ]";
+struct JsonString {
+  std::string_view str;
 
-    if (not requires_logical_names.empty()) {
-      std::cout << ",";
+  friend std::ostream &operator<<(std::ostream &os, JsonString s) {
+    os << '"';
+    for (char c : s.str) {
+      switch (c) {
+        case '"': os << R"(\")"; break;
+        case '\\': os << R"(\\)"; break;
+        case '\b': os << R"(\b)"; break;
+        case '\f': os << R"(\f)"; break;
+        case '\n': os << R"(\n)"; break;
+        case '\r': os << R"(\r)"; break;
+        case '\t': os << R"(\t)"; break;
+        default:
+          if (static_cast<unsigned char>(c) < 0x20) {
+            constexpr char HEX[] = "0123456789abcdef";
+            os << R"(\u00)" << HEX[c >> 4] << HEX[c & 0xF];
+          } else {
+            os << c;
+          }
+      }
     }
-    std::cout << "\n";
+    return os << '"';
+  }
+};
+
+// Quoted header names are looked up relative to the including file first.
+// (We don't know the include directories, so otherwise we can't say where
+// a header is.)
+std::optional<std::filesystem::path> header_unit_path(std::string_view source,
+                                                      std::string_view header_unit) {
+  if (not header_unit.starts_with('"')) return std::nullopt;
+  auto header = std::filesystem::path{source}.parent_path()
+              / header_unit.substr(1, header_unit.size() - 2);
+  if (not std::filesystem::exists(header)) return std::nullopt;
+  return header;
+}
+
+// Write a p1689 dependency file on a single line, so that batches of them
+// can be aggregated into a JSON lines manifest.
+void write_ddi(std::ostream &os, std::string_view path, std::string_view primary_output,
+               Scanned const &scanned) {
+  auto const &[is_interface, is_partition, logical_name, maud_module_name,
+               requires_logical_names, header_units, preamble_size,
+               requires_preprocessing, evaluated_conditions] = scanned;
+
+  os << R"({"revision":0,"rules":[{"primary-output":)" << JsonString{primary_output};
+
+  if (is_partition or is_interface) {
+    os << R"(,"provides":[{"is-interface":)" << (is_interface ? "true" : "false");
+    os << R"(,"logical-name":)" << JsonString{logical_name};
+    os << R"(,"source-path":)" << JsonString{path} << "}]";
   }
 
-  if (not requires_logical_names.empty()) {
+  if (not requires_logical_names.empty() or not header_units.empty()) {
+    os << R"(,"requires":[)";
     bool first = true;
-    std::cout << "      \"requires\": [\n";
     for (auto const &name : requires_logical_names) {
-      if (not first) {
-        std::cout << ",\n";
+      if (not first) os << ",";
+      os << R"({"logical-name":)" << JsonString{name} << "}";
+      first = false;
+    }
+    for (std::string_view header_unit : header_units) {
+      if (not first) os << ",";
+      bool angled = header_unit.starts_with('<');
+      os << R"({"logical-name":)"
+         << JsonString{header_unit.substr(1, header_unit.size() - 2)};
+      os << R"(,"lookup-method":)";
+      os << (angled ? R"("include-angle")" : R"("include-quote")");
+      if (auto header = header_unit_path(path, header_unit)) {
+        os << R"(,"source-path":)" << JsonString{header->generic_string()};
       }
-      std::cout << "        {\n";
-      std::cout << "          \"logical-name\": \"" << name << "\"\n";
-      std::cout << "        }";
+      os << "}";
       first = false;
     }
-    std::cout << "\n";
-    std::cout << "      ]\n";
+    os << "]";
+  }
+
+  os << R"(}],"version":1})" << "\n";
+}
+
+// A cmake bracket argument, whose bracket is long enough not to be closed early.
+struct CMakeString {
+  std::string_view str;
+
+  friend std::ostream &operator<<(std::ostream &os, CMakeString s) {
+    std::string fill;
+    while (s.str.find("]" + fill + "]") != std::string_view::npos) fill += '=';
+    // A newline immediately after the opening bracket is ignored.
+    return os << '[' << fill << '[' << (s.str.starts_with('\n') ? "\n" : "") << s.str
+              << ']' << fill << ']';
+  }
+};
+
+// Write the same information as write_ddi() as a call to _maud_scanned(), so that
+// cmake can include a batch of scan results instead of parsing JSON. (Or, if the
+// source must be scanned by the compiler, a call to _maud_preprocessing_scan_required())
+void write_cmake(std::ostream &os, std::string_view path, Scanned const &scanned) {
+  auto const &[is_interface, is_partition, logical_name, maud_module_name,
+               requires_logical_names, header_units, preamble_size,
+               requires_preprocessing, evaluated_conditions] = scanned;
+
+  if (requires_preprocessing) {
+    os << "_maud_preprocessing_scan_required(" << CMakeString{path} << ")\n";
+    return;
   }
 
-  std::cout << "    }\n";
-  std::cout << "  ],\n";
-  std::cout << "  \"version\": 1\n";
-  std::cout << "}\n";
+  os << "_maud_scanned(" << CMakeString{path} << ' ';
+  os << CMakeString{is_partition or is_interface ? logical_name : ""} << ' ';
+  os << (is_interface ? "ON" : "OFF") << ' ';
+
+  std::string imports;
+  for (auto const &name : requires_logical_names) {
+    if (not imports.empty()) imports += ';';
+    imports += name;
+  }
+  os << CMakeString{imports} << ")\n";
 }
 
 void test_chomp_until_end_of_string_literal(char const *cases) {
@@ -362,28 +953,390 @@ void test_chomp_until_end_of_string_literal(char const *cases) {
   }
 }
 
-int main(int, char **) {
-  char const *files = std::getenv("FILES_TO_SCAN");
-  if (files) {
-    while (*files != 0) {
-      auto *c_file = files;
-      chomp_until(first_of<';'>, files);
-      std::string_view file{c_file, files};
-      if (*files != 0) {
-        ++files;
+// Bump this whenever the output of scan() or write_ddi() changes,
+// so that stale ddis won't be read from a scan cache.
+constexpr std::string_view CACHE_VERSION = "maud_scan 4";
+
+std::optional<std::vector<std::string>> read_source_dependencies(char const *s) {
+  if (not try_chomp_prefix("{", s)) return std::nullopt;
+  while (*s != 0 and not try_chomp_prefix(R"("Includes")", s)) ++s;
+  chomp_until(first_of<'['>, s);
+  if (*s == 0) return std::nullopt;
+
+  std::vector<std::string> prerequisites;
+  while (true) {
+    chomp_until(first_of<'"', ']'>, ++s);
+    if (*s != '"') break;
+
+    auto &prerequisite = prerequisites.emplace_back();
+    for (++s; *s != '"'; ++s) {
+      if (*s == 0) return std::nullopt;
+      if (*s == '\\') {
+        // Paths only need their backslashes and quotes escaped.
+        if (s[1] != '\\' and s[1] != '"' and s[1] != '/') return std::nullopt;
+        ++s;
       }
+      prerequisite += *s;
+    }
+  }
+  if (*s != ']') return std::nullopt;
+  return prerequisites;
+}
+
+// Read the prerequisites from a make-style depfile, as written by -MD, or from
+// the "Includes" of MSVC's /sourceDependencies json. Returns nullopt if the
+// depfile is missing or can't be parsed.
+std::optional<std::vector<std::string>> read_depfile(std::string_view path) {
+  if (not std::filesystem::exists(path)) return std::nullopt;
+  auto contents = read(path);
+
+  auto *s = contents.c_str();
+  chomp_until(first_not_of<' ', '\n', '\r', '\t'>, s);
+  if (*s == '{') return read_source_dependencies(s);
 
-      if (file.empty()) continue;
-      // TODO single-headerify and then vendor boost interprocess so that
-      // we can use a mapped file. We usually won't need the whole file in
-      // memory to read the interface block; just the first few pages should do.
-      auto contents = read(file);
-      scan_file(file, contents.c_str());
+  std::vector<std::string> tokens{""};
+  for (auto *c = contents.c_str(); *c != 0; ++c) {
+    if (*c == '\\' and (c[1] == ' ' or c[1] == '#')) {
+      tokens.back() += *++c;
+    } else if (*c == '$' and c[1] == '$') {
+      tokens.back() += *++c;
+    } else if (*c == '\\' and (c[1] == '\n' or c[1] == '\r')) {
+      tokens.emplace_back();
+    } else if (*c == ' ' or *c == '\t' or *c == '\n' or *c == '\r') {
+      tokens.emplace_back();
+    } else {
+      tokens.back() += *c;
     }
   }
+  std::erase(tokens, "");
 
-  auto cases = read("end_of_string_literal.cases");
-  test_chomp_until_end_of_string_literal(cases.c_str());
+  // Targets are followed by (or end with) a colon.
+  std::vector<std::string> prerequisites;
+  bool has_rule = false;
+  for (auto &token : tokens) {
+    if (token == ":" and not prerequisites.empty()) {
+      prerequisites.pop_back();
+    }
+    if (token.ends_with(':')) {
+      has_rule = true;
+      continue;
+    }
+    prerequisites.push_back(std::move(token));
+  }
+  if (not has_rule) return std::nullopt;
+
+  std::ranges::sort(prerequisites);
+  prerequisites.erase(std::unique(prerequisites.begin(), prerequisites.end()),
+                      prerequisites.end());
+  return prerequisites;
+}
+
+// Usage: maud_scan [--jobs=N] [--manifest=MANIFEST] [--cmake=FRAGMENT] [--batch=BATCH]
+//                  [--defines=DEFINES] [--depfile=DEP]
+//                  [--cache=CACHE [--flags=FLAGS] [--lookup | --store]]
+//                  [--rescan [--scripts=SCRIPTS]] [SOURCE DDI]...
+//
+// Each SOURCE is scanned and a p1689 dependency file is written to the
+// corresponding DDI. BATCH names a file containing a ;-list of additional
+// alternating SOURCE and DDI paths, which avoids command line length limits.
+// If MANIFEST is specified then it will be written with the contents of every
+// DDI, one per line and in the order the sources were provided. Likewise if
+// FRAGMENT is specified then it will be written with a cmake call to
+// _maud_scanned() for each source, so that cmake needn't parse the DDIs.
+//
+// Sources are scanned by N threads (by default, one per hardware thread).
+// The manifest and fragment are written after all sources have been scanned,
+// so their contents do not depend on N.
+//
+// Conditional preprocessing directives in each preamble are evaluated, given the
+// macros defined in DEFINES (usually options.h) and by the preamble itself. If a
+// preamble has declarations in a conditional group whose condition depends on
+// other macros, the source must be scanned by the compiler instead. Its FRAGMENT
+// entry will be a call to _maud_preprocessing_scan_required() and it will not be
+// cached; when rescanning it is printed as PREPROCESSING REQUIRED.
+//
+// If CACHE is specified then it is a directory of previously written DDIs,
+// keyed by a hash of the source's preamble (everything up to the end of its
+// import declarations) along with its paths and FLAGS. DDIs found there are
+// copied instead of formatted. This also allows scans by other tools to be
+// cached: with --lookup nothing will be written for uncached sources and the
+// exit status will be 2 if any were not found, and with --store each DDI
+// (which the other tool wrote) will be added to the cache. Since such scans
+// also depend on included files, DEP names the make-style depfile written by
+// the other tool; each prerequisite listed there is hashed on --store and
+// --lookup misses if any of them has changed. Scans whose depfile can't be
+// read aren't stored.
+//
+// With --rescan, only sources which have been modified since their DDI was
+// written will be scanned (to DDI.new). If the new DDI differs from the old
+// one, both are printed to stdout; otherwise the new DDI is discarded and the
+// old DDI touched. SCRIPTS is formatted like BATCH, but names sources which
+// will be rescanned by running their scan script (DDI.scan.sh or DDI.scan.bat)
+// rather than by maud_scan itself.
+//
+// For debugging, if FILES_TO_SCAN is defined in the environment then the
+// ;-list of sources it contains will be scanned to stdout instead.
+int main(int argc, char **argv) try {
+  std::string_view manifest_path, cmake_path, cache_dir, flags, depfile;
+  Padded<> defines_file;
+  std::optional<Macros> defines;
+  enum { SCAN, LOOKUP, STORE, RESCAN } mode = SCAN;
+  unsigned jobs = default_jobs();
+  std::vector<std::string> sources_and_ddis, scripted_sources_and_ddis;
+  Padded<> batch, scripts;
+
+  auto append_list = [](char const *list, std::vector<std::string> &items) {
+    while (*list != 0) {
+      auto *begin = list;
+      chomp_until(first_of<';'>, list);
+      std::string_view item{begin, list};
+      if (*list != 0) {
+        ++list;
+      }
+
+      if (item.empty()) continue;
+      items.emplace_back(item);
+    }
+  };
+
+  for (std::string_view arg : std::span{argv + 1, argv + argc}) {
+    auto value = arg.substr(arg.find('=') + 1);
+    if (arg.starts_with("--jobs=")) {
+      jobs = std::stoul(std::string{value});
+    } else if (arg.starts_with("--manifest=")) {
+      manifest_path = value;
+    } else if (arg.starts_with("--defines=")) {
+      defines_file = read(value);
+      defines = read_defines(defines_file.c_str());
+    } else if (arg.starts_with("--cmake=")) {
+      cmake_path = value;
+    } else if (arg.starts_with("--batch=")) {
+      batch = read(value);
+      append_list(batch.c_str(), sources_and_ddis);
+    } else if (arg.starts_with("--cache=")) {
+      cache_dir = value;
+    } else if (arg.starts_with("--flags=")) {
+      flags = value;
+    } else if (arg.starts_with("--depfile=")) {
+      depfile = value;
+    } else if (arg == "--lookup") {
+      mode = LOOKUP;
+    } else if (arg == "--store") {
+      mode = STORE;
+    } else if (arg == "--rescan") {
+      mode = RESCAN;
+    } else if (arg.starts_with("--scripts=")) {
+      scripts = read(value);
+      append_list(scripts.c_str(), scripted_sources_and_ddis);
+    } else {
+      sources_and_ddis.emplace_back(arg);
+    }
+  }
+
+  if (sources_and_ddis.size() % 2 != 0 or scripted_sources_and_ddis.size() % 2 != 0) {
+    std::cerr << "Each source must be paired with a DDI path\n";
+    return 1;
+  }
+
+  if ((mode == LOOKUP or mode == STORE) and cache_dir.empty()) {
+    std::cerr << "--lookup and --store require --cache\n";
+    return 1;
+  }
+
+  if (mode == STORE and depfile.empty()) {
+    std::cerr << "--store requires --depfile\n";
+    return 1;
+  }
+
+  if (mode != RESCAN and not scripted_sources_and_ddis.empty()) {
+    std::cerr << "--scripts requires --rescan\n";
+    return 1;
+  }
+
+  if (char const *files = std::getenv("FILES_TO_SCAN")) {
+    std::vector<std::string> files_to_scan;
+    append_list(files, files_to_scan);
+    for (auto const &file : files_to_scan) {
+      Mapped contents{file};
+      write_ddi(std::cout, file, file + ".o",
+                scan(contents.c_str(), defines ? &*defines : nullptr));
+    }
+    return 0;
+  }
+
+  if (sources_and_ddis.empty() and manifest_path.empty() and cmake_path.empty()) {
+    auto cases = read("end_of_string_literal.cases");
+    test_chomp_until_end_of_string_literal(cases.c_str());
+    return 0;
+  }
+
+  std::atomic<bool> missed{false};
+  auto prerequisites_unchanged = [](std::filesystem::path const &deps_path) {
+    std::ifstream deps{deps_path};
+    if (not deps) return false;
+    std::string hash, prerequisite;
+    while (std::getline(deps >> hash >> std::ws, prerequisite)) {
+      if (not std::filesystem::exists(prerequisite)
+          or Hash{}.field(Mapped{prerequisite}).hex() != hash) {
+        return false;
+      }
+    }
+    return true;
+  };
+  struct ScanResult {
+    std::string ddi, fragment;
+    bool requires_preprocessing = false;
+  };
+  auto scan_to = [&](std::string_view source, std::string_view ddi_path) {
+    // The primary output is the object file, whose path is the ddi's without ".ddi"
+    // (the ddi's path may have an additional suffix, as when rescanning to .ddi.new)
+    std::string_view primary_output = ddi_path.substr(0, ddi_path.rfind(".ddi"));
+
+    // We usually won't need the whole file to read the interface block;
+    // mapping ensures only the first few pages are read.
+    Mapped contents{source};
+    auto scanned = scan(contents.c_str(), defines ? &*defines : nullptr);
 
-  return 0;
+    ScanResult result;
+    result.requires_preprocessing = scanned.requires_preprocessing;
+    std::stringstream fragment;
+    write_cmake(fragment, source, scanned);
+    result.fragment = std::move(fragment).str();
+
+    std::filesystem::path cached;
+    // Scans which must be redone by the compiler aren't cached (unless the
+    // compiler's scan is being stored or looked up).
+    if (not cache_dir.empty()
+        and (mode == LOOKUP or mode == STORE or not scanned.requires_preprocessing)) {
+      Hash hash;
+      hash.field(CACHE_VERSION)
+          .field(source)
+          .field(primary_output)
+          .field(flags)
+          .field(scanned.evaluated_conditions and defines ? std::string_view{defines_file}
+                                                         : "")
+          .field({contents.c_str(), scanned.preamble_size});
+      // Whether a quoted header unit was found is written to the ddi.
+      for (auto const &header_unit : scanned.header_units) {
+        hash.field(header_unit_path(source, header_unit) ? "found" : "");
+      }
+      cached = std::filesystem::path{cache_dir} / hash.hex() + ".ddi";
+
+      if (mode == STORE) {
+        // The compiler's scan also depends on every file it included,
+        // so record their hashes to be checked by --lookup.
+        auto prerequisites = read_depfile(depfile);
+        if (not prerequisites) return ScanResult{};
+
+        std::stringstream deps;
+        for (auto const &prerequisite : *prerequisites) {
+          if (not std::filesystem::exists(prerequisite)) return ScanResult{};
+          deps << Hash{}.field(Mapped{prerequisite}).hex() << " " << prerequisite << "\n";
+        }
+        write(cached + ".deps.tmp") << std::move(deps).str();
+        std::filesystem::rename(cached + ".deps.tmp", cached + ".deps");
+
+        std::filesystem::copy_file(ddi_path, cached + ".tmp",
+                                   std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::rename(cached + ".tmp", cached);
+        return ScanResult{};
+      }
+
+      if (std::filesystem::exists(cached)
+          and (mode != LOOKUP or prerequisites_unchanged(cached + ".deps"))) {
+        result.ddi = read(cached);
+        write(ddi_path) << result.ddi;
+        return result;
+      }
+
+      if (mode == LOOKUP) {
+        missed = true;
+        return ScanResult{};
+      }
+    }
+
+    std::stringstream stream;
+    write_ddi(stream, source, primary_output, scanned);
+    result.ddi = std::move(stream).str();
+    write(ddi_path) << result.ddi;
+
+    if (not cached.empty()) {
+      // Write then rename, so that a concurrent reader never sees a partial ddi
+      write(cached + ".tmp") << result.ddi;
+      std::filesystem::rename(cached + ".tmp", cached);
+    }
+    return result;
+  };
+
+  if (mode == RESCAN) {
+    auto rescan = [&](std::string_view source, std::string const &ddi_path,
+                      bool scripted) -> std::string {
+      namespace fs = std::filesystem;
+      std::error_code ec;
+      auto ddi_time = fs::last_write_time(ddi_path, ec);
+      if (ec) return "UNSCANNED " + std::string{source};
+
+      // As with IS_NEWER_THAN, a deleted source or an equal time stamp needs no rescan
+      auto source_time = fs::last_write_time(source, ec);
+      if (ec or ddi_time >= source_time) return "";
+
+      auto new_path = ddi_path + ".new";
+      if (scripted) {
+        auto command = fs::exists(ddi_path + ".scan.bat")
+                         ? "\"" + ddi_path + ".scan.bat\" .new"
+                         : "sh \"" + ddi_path + ".scan.sh\" .new";
+        if (std::system(command.c_str()) != 0) {
+          throw std::runtime_error{"failed to rescan " + std::string{source}};
+        }
+      } else if (scan_to(source, new_path).requires_preprocessing) {
+        fs::remove(new_path);
+        return "PREPROCESSING REQUIRED " + std::string{source};
+      }
+
+      auto old_ddi = read(ddi_path), new_ddi = read(new_path);
+      if (std::string_view{old_ddi} != std::string_view{new_ddi}) {
+        return "BEFORE=" + std::string{old_ddi} + "\nAFTER=" + std::string{new_ddi};
+      }
+      fs::remove(new_path);
+      fs::last_write_time(ddi_path, fs::file_time_type::clock::now());
+      return "";
+    };
+
+    size_t count = sources_and_ddis.size() / 2;
+    std::vector<std::string> changes(count + scripted_sources_and_ddis.size() / 2);
+    parallel_for(changes.size(), jobs, [&](size_t i) {
+      auto const &pairs = i < count ? sources_and_ddis : scripted_sources_and_ddis;
+      auto j = i < count ? i : i - count;
+      changes[i] = rescan(pairs[j * 2], pairs[j * 2 + 1], i >= count);
+    });
+
+    for (auto const &change : changes) {
+      if (change.empty()) continue;
+      std::cout << change << std::endl;
+    }
+    return 0;
+  }
+
+  std::vector<ScanResult> results(sources_and_ddis.size() / 2);
+  parallel_for(results.size(), jobs, [&](size_t i) {
+    results[i] = scan_to(sources_and_ddis[i * 2], sources_and_ddis[i * 2 + 1]);
+  });
+
+  if (not manifest_path.empty()) {
+    auto manifest = write(manifest_path);
+    for (auto const &result : results) {
+      manifest << result.ddi;
+    }
+  }
+
+  if (not cmake_path.empty()) {
+    auto cmake = write(cmake_path);
+    for (auto const &result : results) {
+      cmake << result.fragment;
+    }
+  }
+  return missed ? 2 : 0;
+} catch (std::exception const &e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
 }
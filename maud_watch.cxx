@@ -0,0 +1,246 @@
+// Boost Licensed
+//
+module;
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+module executable;
+
+import maud_;
+
+namespace fs = std::filesystem;
+
+// Usage: maud_watch WATCH ROOT...
+//        maud_watch --sync WATCH
+//
+// Watch each ROOT (recursively, excluding hidden directories) for files and
+// directories being created, deleted, or renamed. This runs in the background
+// so that glob verification can skip globbing when nothing has changed.
+//
+// While running maud_watch holds a lock on WATCH/lock, so a dead watcher is
+// detectable with file(LOCK ... TIMEOUT 0). To synchronize, write a token to
+// WATCH/sync. Once every event which preceded that write has been appended to
+// WATCH/journal, the token will be written to WATCH/synced. The journal is not
+// otherwise modified by maud_watch, so it can be removed once it has been acted
+// on. Writing to WATCH/stop shuts the watcher down.
+//
+// To wait for synchronization without polling, read N from WATCH/armed before
+// writing the token, then file(LOCK WATCH/sync.N.lock). maud_watch holds that
+// lock until it has written the next token to WATCH/synced; before releasing
+// it, it locks the other of sync.0.lock and sync.1.lock and updates WATCH/armed.
+//
+// maud_watch --sync WATCH does exactly that, then exits with 0 if the watcher
+// echoed its token. (A stuck watcher would block it indefinitely, so it should be
+// run with a timeout. file(LOCK ... TIMEOUT) isn't used instead because it only
+// retries once per second.)
+//
+// Events are only guaranteed to be journaled while maud_watch holds the lock,
+// so the journal initially contains START to indicate that events preceding
+// startup may have been missed.
+#ifdef __linux__
+int sync(fs::path const &watch) {
+  if (not fs::exists(watch / "armed")) return 1;
+  std::string armed{read(watch / "armed")};
+
+  auto path = watch / ("sync." + armed + ".lock");
+  int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) return 1;
+
+  auto token = std::to_string(std::random_device{}());
+  write(watch / "sync") << token;
+
+  struct flock lock {};
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  while (fcntl(fd, F_SETLKW, &lock) != 0) {
+    if (errno != EINTR) return 1;
+  }
+  if (not fs::exists(watch / "synced")) return 1;
+  return std::string_view{read(watch / "synced")} == token ? 0 : 1;
+}
+
+int main(int argc, char **argv) try {
+  if (argc == 3 and std::string_view{argv[1]} == "--sync") return sync(argv[2]);
+
+  if (argc < 3) {
+    std::cerr << "USAGE ERROR: maud_watch <WATCH> <ROOT>... | --sync <WATCH>"
+              << std::endl;
+    return EINVAL;
+  }
+
+  fs::path watch = argv[1];
+  fs::create_directories(watch);
+
+  int lock_fd = open((watch / "lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  struct flock lock {};
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  if (lock_fd < 0 or fcntl(lock_fd, F_SETLK, &lock) != 0) {
+    std::cout << "another maud_watch is already running" << std::endl;
+    return 0;
+  }
+
+  int sync_lock_fds[2];
+  for (int n : {0, 1}) {
+    auto path = watch / ("sync." + std::to_string(n) + ".lock");
+    sync_lock_fds[n] = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (sync_lock_fds[n] < 0) {
+      throw std::system_error{errno, std::system_category(), "opening " + path.string()};
+    }
+  }
+  // Blocks while a synchronizing cmake still holds the lock from a previous sync.
+  auto arm = [&](int n) {
+    struct flock lock {};
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    while (fcntl(sync_lock_fds[n], F_SETLKW, &lock) != 0) {
+      if (errno != EINTR) throw std::system_error{errno, std::system_category(), "lock"};
+    }
+    write(watch / "armed.tmp") << n;
+    fs::rename(watch / "armed.tmp", watch / "armed");
+  };
+  auto disarm = [&](int n) {
+    struct flock lock {};
+    lock.l_type = F_UNLCK;
+    lock.l_whence = SEEK_SET;
+    fcntl(sync_lock_fds[n], F_SETLK, &lock);
+  };
+  int armed = 0;
+  arm(armed);
+
+  int inotify = inotify_init1(IN_CLOEXEC);
+  if (inotify < 0) throw std::system_error{errno, std::system_category(), "inotify"};
+
+  std::unordered_map<int, std::string> directories;
+  constexpr uint32_t MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                          | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+  auto add_watch = [&](std::string const &dir, uint32_t mask) {
+    int wd = inotify_add_watch(inotify, dir.c_str(), mask);
+    if (wd < 0) {
+      // Most likely we've exceeded fs.inotify.max_user_watches. We can't provide
+      // a complete journal, so exit and let verification fall back to globbing.
+      throw std::system_error{errno, std::system_category(), "watching " + dir};
+    }
+    // A renamed directory keeps its watch descriptor; update its path. (The paths
+    // of its subdirectories will be stale, but they are only used for logging.)
+    directories[wd] = dir;
+    return wd;
+  };
+
+  auto watch_tree = [&](std::string const &root) {
+    int root_wd = add_watch(root, MASK);
+    std::vector<fs::path> unlisted{root};
+    while (not unlisted.empty()) {
+      auto dir = std::move(unlisted.back());
+      unlisted.pop_back();
+      std::error_code ec;
+      for (fs::directory_iterator it{dir, ec}, end; not ec and it != end;
+           it.increment(ec)) {
+        if (it->path().filename().native().starts_with(".")) continue;
+        if (it->is_directory(ec) and not it->is_symlink(ec)) {
+          add_watch(it->path().string(), MASK);
+          unlisted.push_back(it->path());
+        }
+      }
+    }
+    return root_wd;
+  };
+
+  int sync_wd = add_watch(watch.string(), IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF);
+  std::vector<int> root_wds;
+  for (std::string root : std::span{argv + 2, argv + argc}) {
+    root_wds.push_back(watch_tree(root));
+  }
+
+  std::string pending = "START\n";
+  std::cout << "watching" << std::endl;
+
+  alignas(inotify_event) char buffer[1 << 16];
+  while (true) {
+    long size = read(inotify, buffer, sizeof(buffer));
+    if (size < 0) {
+      if (errno == EINTR) continue;
+      throw std::system_error{errno, std::system_category(), "reading inotify events"};
+    }
+
+    for (long offset = 0; offset < size;) {
+      auto *event = reinterpret_cast<inotify_event const *>(buffer + offset);
+      offset += sizeof(inotify_event) + event->len;
+      std::string_view name = event->len ? event->name : "";
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        // Events were dropped, so some new directories may be unwatched.
+        throw std::runtime_error{"inotify queue overflowed"};
+      }
+
+      if (event->mask & IN_IGNORED) {
+        directories.erase(event->wd);
+        continue;
+      }
+
+      if (event->wd == sync_wd) {
+        if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF) or name == "stop") {
+          std::cout << "stopping" << std::endl;
+          return 0;
+        }
+        if (name != "sync") continue;
+
+        std::string token{read(watch / "sync")};
+        if (not pending.empty()) {
+          std::ofstream{watch / "journal", std::ios_base::app} << pending;
+          pending.clear();
+        }
+        write(watch / "synced.tmp") << token;
+        fs::rename(watch / "synced.tmp", watch / "synced");
+        arm(1 - armed);
+        disarm(armed);
+        armed = 1 - armed;
+        continue;
+      }
+
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        if (std::find(root_wds.begin(), root_wds.end(), event->wd) != root_wds.end()) {
+          throw std::runtime_error{"root " + directories[event->wd] + " was removed"};
+        }
+        continue;
+      }
+
+      if (name.starts_with(".")) continue;
+
+      auto path = directories[event->wd] + "/" + std::string{name};
+      if ((event->mask & (IN_CREATE | IN_MOVED_TO)) and (event->mask & IN_ISDIR)) {
+        watch_tree(path);
+      }
+
+      auto kind = event->mask & IN_CREATE     ? "CREATE "
+                : event->mask & IN_DELETE     ? "DELETE "
+                : event->mask & IN_MOVED_FROM ? "MOVE_FROM "
+                                              : "MOVE_TO ";
+      pending += kind + path + "\n";
+    }
+  }
+} catch (std::exception const &e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+}
+#else
+int main() {
+  std::cerr << "maud_watch is only supported on Linux" << std::endl;
+  return ENOSYS;
+}
+#endif
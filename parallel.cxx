@@ -0,0 +1,97 @@
+// Boost Licensed
+//
+module;
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+export module maud_:parallel;
+
+export unsigned default_jobs() {
+  return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+// Invoke body(i) for each i in [0, count) using up to `jobs` threads.
+//
+// Each thread starts with a contiguous share of the indices, which it consumes
+// from the front. When a thread's share is exhausted it steals the back half of
+// another thread's remaining share, so a few expensive items don't leave the
+// other threads idle. If any invocation throws, no further items are started
+// and the first exception is rethrown once all threads have joined.
+export void parallel_for(size_t count, unsigned jobs, auto &&body) {
+  jobs = std::min<size_t>(jobs, count);
+  if (jobs <= 1) {
+    for (size_t i = 0; i < count; ++i) body(i);
+    return;
+  }
+
+  struct Share {
+    std::mutex mutex;
+    size_t begin, end;
+  };
+  std::vector<Share> shares(jobs);
+  for (size_t w = 0; w < jobs; ++w) {
+    shares[w].begin = count * w / jobs;
+    shares[w].end = count * (w + 1) / jobs;
+  }
+
+  std::atomic<bool> failed{false};
+  std::mutex error_mutex;
+  std::exception_ptr error;
+
+  auto pop = [&](Share &share, size_t &i) {
+    std::lock_guard lock{share.mutex};
+    if (share.begin == share.end) return false;
+    i = share.begin++;
+    return true;
+  };
+
+  auto steal = [&](size_t w) {
+    for (size_t v = (w + 1) % jobs; v != w; v = (v + 1) % jobs) {
+      size_t begin, end;
+      {
+        std::lock_guard lock{shares[v].mutex};
+        auto remaining = shares[v].end - shares[v].begin;
+        if (remaining == 0) continue;
+        end = shares[v].end;
+        begin = shares[v].end -= (remaining + 1) / 2;
+      }
+      std::lock_guard lock{shares[w].mutex};
+      shares[w].begin = begin;
+      shares[w].end = end;
+      return true;
+    }
+    return false;
+  };
+
+  auto work = [&](size_t w) {
+    size_t i;
+    while (not failed.load(std::memory_order_relaxed)) {
+      if (not pop(shares[w], i)) {
+        if (steal(w)) continue;
+        return;
+      }
+      try {
+        body(i);
+      } catch (...) {
+        std::lock_guard lock{error_mutex};
+        if (not error) error = std::current_exception();
+        failed = true;
+        return;
+      }
+    }
+  };
+
+  {
+    std::vector<std::jthread> threads;
+    for (size_t w = 1; w < jobs; ++w) {
+      threads.emplace_back(work, w);
+    }
+    work(0);
+  }
+
+  if (error) std::rethrow_exception(error);
+}
@@ -1,8 +1,17 @@
 // Boost Licensed
 //
 module;
+#if defined(__GNUC__) and (defined(__x86_64__) or defined(__i386__))
+#include <immintrin.h>
+#define MAUD_SIMD_X86 1
+#endif
+#include <algorithm>
+#include <bit>
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 export module maud_:parsing;
 
 template <bool INVERT, char... CHARS>
@@ -32,37 +41,163 @@ export constexpr auto find_first(auto predicate, auto str) {
   return str;
 }
 
+#ifdef MAUD_SIMD_X86
+// Vectorized searches load blocks from aligned addresses, so reading past the
+// terminating zero never crosses into another page. The bytes of the first
+// block which precede the string are shifted out of its mask. Those loads are
+// out of bounds as far as ASan knows, so they aren't instrumented.
+template <size_t SIZE>
+struct Simd;
+
+template <>
+struct Simd<16> {
+  template <bool INVERT, char... CHARS>
+  [[gnu::no_sanitize_address]] static uint32_t mask(char const *block) {
+    auto v = _mm_load_si128(reinterpret_cast<__m128i const *>(block));
+    auto eq = _mm_setzero_si128();
+    ((eq = _mm_or_si128(eq, _mm_cmpeq_epi8(v, _mm_set1_epi8(CHARS)))), ...);
+    uint32_t m = _mm_movemask_epi8(eq);
+    if constexpr (INVERT) m = ~m & 0xFFFF;
+    return m | _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+  }
+
+  template <bool INVERT, char... CHARS>
+  [[gnu::no_sanitize_address]] static char const *find_first(char const *str) {
+    auto offset = reinterpret_cast<uintptr_t>(str) % 16;
+    auto const *block = str - offset;
+    if (auto m = mask<INVERT, CHARS...>(block) >> offset) {
+      return str + std::countr_zero(m);
+    }
+    while (true) {
+      block += 16;
+      if (auto m = mask<INVERT, CHARS...>(block)) {
+        return block + std::countr_zero(m);
+      }
+    }
+  }
+};
+
+template <>
+struct Simd<32> {
+  template <bool INVERT, char... CHARS>
+  [[gnu::no_sanitize_address, gnu::target("avx2")]] static uint32_t mask(
+      char const *block) {
+    auto v = _mm256_load_si256(reinterpret_cast<__m256i const *>(block));
+    auto eq = _mm256_setzero_si256();
+    ((eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(CHARS)))), ...);
+    uint32_t m = _mm256_movemask_epi8(eq);
+    if constexpr (INVERT) m = ~m;
+    return m | _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+  }
+
+  template <bool INVERT, char... CHARS>
+  [[gnu::no_sanitize_address, gnu::target("avx2")]] static char const *find_first(
+      char const *str) {
+    auto offset = reinterpret_cast<uintptr_t>(str) % 32;
+    auto const *block = str - offset;
+    if (auto m = mask<INVERT, CHARS...>(block) >> offset) {
+      return str + std::countr_zero(m);
+    }
+    while (true) {
+      block += 32;
+      if (auto m = mask<INVERT, CHARS...>(block)) {
+        return block + std::countr_zero(m);
+      }
+    }
+  }
+};
+
+bool has_avx2() {
+  static bool const HAS_AVX2 = __builtin_cpu_supports("avx2");
+  return HAS_AVX2;
+}
+#endif
+
+export template <bool INVERT, char... CHARS>
+constexpr char const *find_first(CharPredicate<INVERT, CHARS...> predicate,
+                                 char const *str) {
+#ifdef MAUD_SIMD_X86
+  if (not std::is_constant_evaluated()) {
+    if (has_avx2()) return Simd<32>::find_first<INVERT, CHARS...>(str);
+    return Simd<16>::find_first<INVERT, CHARS...>(str);
+  }
+#endif
+  while (*str != 0 and not predicate(*str)) {
+    ++str;
+  }
+  return str;
+}
+
+// The starts of each line in a null terminated buffer. Lines are only indexed
+// as far as the furthest position looked up so far, so scanning a buffer costs
+// nothing extra until a line or column is actually needed (usually for
+// diagnostics).
+export class LineIndex {
+ public:
+  explicit LineIndex(char const *begin) : _line_begins{begin}, _indexed{begin} {}
+
+  // The zero based line containing pos
+  uint32_t line(char const *pos) const {
+    while (_indexed < pos and *_indexed != 0) {
+      _indexed = find_first(OF<'\n'>, _indexed);
+      if (*_indexed == 0) break;
+      _line_begins.push_back(++_indexed);
+    }
+    auto it = std::upper_bound(_line_begins.begin(), _line_begins.end(), pos);
+    return static_cast<uint32_t>(it - _line_begins.begin() - 1);
+  }
+
+  char const *line_begin(uint32_t line) const { return _line_begins[line]; }
+
+ private:
+  mutable std::vector<char const *> _line_begins;
+  // Every line beginning before this has been indexed.
+  mutable char const *_indexed;
+};
+
+// A position in a null terminated buffer. Advancing is just pointer arithmetic;
+// line and column are computed on demand from a shared LineIndex.
 export struct Location {
-  Location(char const *begin) : line_begin{begin} {}
-  char const *line_begin;
-  uint16_t line = 0, column = 0;
+  Location(char const *pos, LineIndex const &index) : pos{pos}, index{&index} {}
+  char const *pos;
+  LineIndex const *index;
 
-  char const &operator*() const { return line_begin[column]; }
+  char const &operator*() const { return *pos; }
 
   Location operator++(int) {
     Location copy = *this;
-    ++*this;
+    ++pos;
     return copy;
   }
 
   Location &operator++() {
-    if (line_begin[column++] == '\n') {
-      line_begin += column;
-      column = 0;
-      ++line;
-    }
+    ++pos;
     return *this;
   }
 
+  uint32_t line() const { return index->line(pos); }
+
+  uint32_t column() const {
+    return static_cast<uint32_t>(pos - index->line_begin(line()));
+  }
+
   std::string_view view_line() const {
-    return {line_begin, find_first(OF<'\r', '\n'>, &**this)};
+    return {index->line_begin(line()), find_first(OF<'\r', '\n'>, pos)};
   }
 
-  std::string_view view_to(Location end) const { return {&**this, &*end}; }
+  std::string_view view_to(Location end) const { return {pos, end.pos}; }
 
   std::string line_column() const {
-    return std::to_string(line + 1) + ":" + std::to_string(column + 1);
+    auto l = line();
+    return std::to_string(l + 1) + ":" + std::to_string(pos - index->line_begin(l) + 1);
   }
 
-  bool operator==(Location const &) const = default;
+  bool operator==(Location const &other) const { return pos == other.pos; }
 };
+
+// Scan Locations with the same (vectorized) search as raw pointers.
+export template <bool INVERT, char... CHARS>
+constexpr Location find_first(CharPredicate<INVERT, CHARS...> predicate, Location loc) {
+  loc.pos = find_first(predicate, loc.pos);
+  return loc;
+}
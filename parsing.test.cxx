@@ -0,0 +1,83 @@
+module;
+#include <random>
+#include <string>
+module test_;
+
+import maud_;
+
+using std::operator""s;
+
+// The byte-at-a-time search which find_first is expected to agree with.
+template <bool INVERT = false>
+char const *reference_find_first(std::string_view chars, char const *str) {
+  while (*str != 0 and (chars.find(*str) == std::string_view::npos) != INVERT) {
+    ++str;
+  }
+  return str;
+}
+
+TEST_(vectorized_search, 0, 1, 7, 15, 16, 31, 32, 33, 63) {
+  std::mt19937 rng{static_cast<unsigned>(parameter)};
+  std::uniform_int_distribution<int> alphabet{'a', 'f'};
+
+  // Searches must begin at every alignment, and terminate
+  // at a match or at the trailing zeros.
+  auto padded = std::string(64, '\0') + std::string(parameter, 'x');
+  padded += std::string(64, '\0');
+  for (int i = 64; i != 64 + parameter; ++i) {
+    padded[i] = static_cast<char>(alphabet(rng));
+  }
+
+  for (int i = 64; i <= 64 + parameter; ++i) {
+    char const *str = padded.c_str() + i;
+    EXPECT_(find_first(OF<'a'>, str) == reference_find_first("a", str));
+    EXPECT_(find_first(OF<'e', 'f'>, str) == reference_find_first("ef", str));
+    EXPECT_(find_first(not OF<'a', 'b', 'c'>, str)
+            == reference_find_first<true>("abc", str));
+    EXPECT_(find_first(SPACE, str) == reference_find_first(" \r\n\t", str));
+  }
+}
+
+TEST_(location) {
+  // More lines than would fit in 16 bits.
+  std::string buffer;
+  for (int i = 0; i < 70'000; ++i) buffer += "ab\n";
+  buffer += "  last line";
+
+  LineIndex index{buffer.c_str()};
+  Location loc{buffer.c_str(), index};
+  // Lines are indexed out of order: first the last, then the first.
+  auto last = find_first(OF<'l'>, loc);
+  EXPECT_(last != loc);
+  EXPECT_(last.line_column() == "70001:3");
+  EXPECT_(last.view_line() == "  last line");
+  EXPECT_(loc.line_column() == "1:1");
+
+  auto newline = find_first(OF<'\n'>, loc);
+  EXPECT_(newline.line() == 0);
+  EXPECT_(newline.column() == 2);
+  EXPECT_((++newline).line_column() == "2:1");
+}
+
+// A large input, to compare find_first with a byte-at-a-time search for its end.
+std::string large_input() {
+  return std::string(64 << 20, 'x') + "\n" + std::string(64, '\0');
+}
+
+BENCHMARK_(find_first_byte_at_a_time) {
+  auto large = large_input();
+  benchmark.samples = 5;
+  for (auto _ : benchmark) {
+    auto end = find_first([](char c) { return c == '\r' or c == '\n'; }, large.c_str());
+    do_not_optimize(end);
+  }
+}
+
+BENCHMARK_(find_first_vectorized) {
+  auto large = large_input();
+  benchmark.samples = 5;
+  for (auto _ : benchmark) {
+    auto end = find_first(OF<'\r', '\n'>, large.c_str());
+    do_not_optimize(end);
+  }
+}
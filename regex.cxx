@@ -0,0 +1,269 @@
+// Boost Licensed
+//
+module;
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+export module maud_:regex;
+
+// A matcher for CMake's regular expression syntax (as used by list(FILTER)
+// and if(MATCHES)): ^ $ . [] [^] * + ? | () with \ escaping the next character.
+//
+// Patterns are compiled to an NFA, from which a DFA is built lazily as inputs
+// are searched. Since a DFA state is added for each distinct set of NFA states
+// reached, each input byte costs only a table lookup once the DFA is warm.
+// Searching mutates that cache, so a Regex must not be shared between threads.
+export class Regex {
+ public:
+  explicit Regex(std::string_view pattern) : _pattern{pattern} {
+    _p = _pattern.data();
+    auto [start, end] = parse_alternation();
+    if (_p != _pattern.data() + _pattern.size()) error("unmatched )");
+    _nfa[end].out = add({State::MATCH});
+    _start = start;
+    _dfa.push_back({});
+    _dfa[0].nfa_states = closure({start}, true);
+    _dfa[0].accepting = contains_match(_dfa[0].nfa_states);
+    _dfa_ids[_dfa[0].nfa_states] = 0;
+  }
+
+  std::string const &pattern() const { return _pattern; }
+
+  // Whether the pattern matches anywhere in the input.
+  bool search(std::string_view input) {
+    if (input.empty()) return accepts_at_end(_dfa[0].nfa_states, true);
+
+    int d = 0;
+    for (unsigned char c : input) {
+      if (_dfa[d].accepting) return true;
+      int next = _dfa[d].next[c];
+      if (next < 0) next = _dfa[d].next[c] = step(d, c);
+      d = next;
+    }
+    if (_dfa[d].accepting) return true;
+    if (_dfa[d].accepts_at_end < 0) {
+      _dfa[d].accepts_at_end = accepts_at_end(_dfa[d].nfa_states, false);
+    }
+    return _dfa[d].accepts_at_end;
+  }
+
+ private:
+  struct State {
+    enum Kind { EPSILON, SPLIT, SET, BOL, EOL, MATCH } kind = EPSILON;
+    int out = -1, out1 = -1;
+    std::bitset<256> set{};
+  };
+
+  struct Fragment {
+    int start, end;
+  };
+
+  struct DfaState {
+    std::vector<int> nfa_states;
+    bool accepting = false;
+    int accepts_at_end = -1;
+    std::array<int, 256> next = [] {
+      std::array<int, 256> next;
+      next.fill(-1);
+      return next;
+    }();
+  };
+
+  [[noreturn]] void error(char const *message) const {
+    throw std::runtime_error{"invalid regex '" + _pattern + "': " + message};
+  }
+
+  int add(State state) {
+    _nfa.push_back(state);
+    return static_cast<int>(_nfa.size() - 1);
+  }
+
+  bool at_end() const { return _p == _pattern.data() + _pattern.size(); }
+
+  Fragment epsilon() {
+    int s = add({State::EPSILON});
+    return {s, s};
+  }
+
+  Fragment parse_alternation() {
+    auto fragment = parse_concatenation();
+    while (not at_end() and *_p == '|') {
+      ++_p;
+      auto alternative = parse_concatenation();
+      int split = add({State::SPLIT, fragment.start, alternative.start});
+      int end = add({State::EPSILON});
+      _nfa[fragment.end].out = end;
+      _nfa[alternative.end].out = end;
+      fragment = {split, end};
+    }
+    return fragment;
+  }
+
+  Fragment parse_concatenation() {
+    auto fragment = epsilon();
+    while (not at_end() and *_p != '|' and *_p != ')') {
+      auto next = parse_repetition();
+      _nfa[fragment.end].out = next.start;
+      fragment.end = next.end;
+    }
+    return fragment;
+  }
+
+  Fragment parse_repetition() {
+    auto atom = parse_atom();
+    while (not at_end() and (*_p == '*' or *_p == '+' or *_p == '?')) {
+      int end = add({State::EPSILON});
+      int split = add({State::SPLIT, atom.start, end});
+      switch (*_p++) {
+        case '*':
+          _nfa[atom.end].out = split;
+          atom = {split, end};
+          break;
+        case '+':
+          _nfa[atom.end].out = split;
+          atom = {atom.start, end};
+          break;
+        case '?':
+          _nfa[atom.end].out = end;
+          atom = {split, end};
+          break;
+      }
+    }
+    return atom;
+  }
+
+  Fragment parse_atom() {
+    State state{State::SET};
+    switch (char c = *_p++) {
+      case '(': {
+        auto group = parse_alternation();
+        if (at_end() or *_p++ != ')') error("unmatched (");
+        return group;
+      }
+      case '*':
+      case '+':
+      case '?':
+        error("nothing to repeat");
+      case '^':
+        state.kind = State::BOL;
+        break;
+      case '$':
+        state.kind = State::EOL;
+        break;
+      case '.':
+        state.set.set();
+        break;
+      case '[':
+        state.set = parse_class();
+        break;
+      case '\\':
+        if (at_end()) error("trailing \\");
+        state.set.set(static_cast<unsigned char>(*_p++));
+        break;
+      default:
+        state.set.set(static_cast<unsigned char>(c));
+    }
+    int s = add(state);
+    int end = add({State::EPSILON});
+    _nfa[s].out = end;
+    return {s, end};
+  }
+
+  std::bitset<256> parse_class() {
+    std::bitset<256> set;
+    bool negated = not at_end() and *_p == '^';
+    if (negated) ++_p;
+    // A ] immediately after [ or [^ is literal
+    for (bool first = true; not at_end() and (first or *_p != ']'); first = false) {
+      unsigned char lo = *_p++;
+      if (not at_end() and *_p == '-' and _p + 1 != _pattern.data() + _pattern.size()
+          and _p[1] != ']') {
+        unsigned char hi = _p[1];
+        _p += 2;
+        for (unsigned c = lo; c <= hi; ++c) set.set(c);
+      } else {
+        set.set(lo);
+      }
+    }
+    if (at_end()) error("unmatched [");
+    ++_p;
+    return negated ? ~set : set;
+  }
+
+  // Follow epsilon transitions. The states collected are those which consume a
+  // character or assert end of input (and MATCH).
+  std::vector<int> closure(std::vector<int> const &states, bool at_start,
+                           bool at_end = false) const {
+    std::vector<bool> visited(_nfa.size());
+    std::vector<int> result, stack = states;
+    while (not stack.empty()) {
+      int s = stack.back();
+      stack.pop_back();
+      if (s < 0 or visited[s]) continue;
+      visited[s] = true;
+      auto const &state = _nfa[s];
+      switch (state.kind) {
+        case State::SPLIT:
+          stack.push_back(state.out1);
+          [[fallthrough]];
+        case State::EPSILON:
+          stack.push_back(state.out);
+          break;
+        case State::BOL:
+          if (at_start) stack.push_back(state.out);
+          break;
+        case State::EOL:
+          if (at_end) {
+            stack.push_back(state.out);
+          } else {
+            result.push_back(s);
+          }
+          break;
+        default:
+          result.push_back(s);
+      }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+  bool contains_match(std::vector<int> const &states) const {
+    for (int s : states) {
+      if (_nfa[s].kind == State::MATCH) return true;
+    }
+    return false;
+  }
+
+  bool accepts_at_end(std::vector<int> const &states, bool at_start) const {
+    return contains_match(closure(states, at_start, true));
+  }
+
+  int step(int d, unsigned char c) {
+    // The pattern may begin matching at any position, so the start state is always
+    // included (though ^ can no longer be satisfied).
+    std::vector<int> moved{_start};
+    for (int s : _dfa[d].nfa_states) {
+      if (_nfa[s].kind == State::SET and _nfa[s].set[c]) moved.push_back(_nfa[s].out);
+    }
+    auto states = closure(moved, false);
+    auto [it, inserted] = _dfa_ids.emplace(states, static_cast<int>(_dfa.size()));
+    if (inserted) {
+      _dfa.push_back({});
+      _dfa.back().accepting = contains_match(states);
+      _dfa.back().nfa_states = std::move(states);
+    }
+    return it->second;
+  }
+
+  std::string _pattern;
+  char const *_p;
+  std::vector<State> _nfa;
+  int _start;
+  std::vector<DfaState> _dfa;
+  std::map<std::vector<int>, int> _dfa_ids;
+};
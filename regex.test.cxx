@@ -0,0 +1,42 @@
+module;
+#include <stdexcept>
+#include <string_view>
+module test_;
+
+import maud_;
+
+// Expected results were taken from CMake's if(<subject> MATCHES <pattern>).
+TEST_(regex_search) {
+  struct Case {
+    std::string_view pattern, subject;
+    bool expected;
+  };
+  for (auto [pattern, subject, expected] : {
+           Case{"[.]cxx$", "foo/bar.cxx", true},
+           Case{"[.]cxx$", "foo/bar.cxx.in", false},
+           Case{"(/|^)[.]", "foo/.git/HEAD", true},
+           Case{"(/|^)[.]", ".clang-format", true},
+           Case{"(/|^)[.]", "foo/bar.baz", false},
+           Case{"^include/", "src/include/x.h", false},
+           Case{"a|b", "xbx", true},
+           Case{"^(ab)+$", "ababab", true},
+           Case{"^(ab)+$", "ababa", false},
+           Case{"x?y*z", "z", true},
+           Case{"[^a-c]", "abc", false},
+           Case{"[]]", "]", true},
+           Case{"a\\.b", "a.b", true},
+           Case{"a\\.b", "axb", false},
+           Case{"$", "", true},
+           Case{"^$", "x", false},
+       }) {
+    EXPECT_(Regex{pattern}.search(subject) == expected);
+  }
+
+  for (auto invalid : {"(", "a)", "*", "[abc", "x\\"}) {
+    try {
+      Regex{invalid};
+      EXPECT_(not "expected an exception");
+    } catch (std::runtime_error const &) {
+    }
+  }
+}